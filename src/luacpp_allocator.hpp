@@ -0,0 +1,142 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace luacpp
+{
+
+/* Size-class pool allocator for lua_newstate
+ * Small blocks are carved from big chunks and recycled through the per-class free lists,
+ * larger blocks go straight to realloc/free.
+ * One instance serves exactly one lua_State, so there is no locking at all
+ */
+class lua_pool_allocator {
+public:
+    static constexpr size_t granularity     = 16;
+    static constexpr size_t max_pooled_size = 512;
+    static constexpr size_t chunk_size      = 64 * 1024;
+
+    lua_pool_allocator() = default;
+
+    lua_pool_allocator(const lua_pool_allocator&)            = delete;
+    lua_pool_allocator& operator=(const lua_pool_allocator&) = delete;
+
+    ~lua_pool_allocator() {
+        for (auto chunk : chunks) std::free(chunk); // NOLINT
+    }
+
+    /* lua_Alloc compatible entry point, ud must be the allocator instance */
+    static void* alloc(void* ud, void* ptr, size_t osize, size_t nsize) noexcept {
+        /* If ptr is NULL, osize encodes the kind of the object (lua >= 5.4) */
+        return static_cast<lua_pool_allocator*>(ud)->reallocate(ptr, ptr ? osize : 0, nsize);
+    }
+
+    void* reallocate(void* ptr, size_t osize, size_t nsize) noexcept {
+        if (nsize == 0) {
+            deallocate(ptr, osize);
+            return nullptr;
+        }
+
+        if (!ptr)
+            return allocate(nsize);
+
+        if (!is_pooled(osize) && !is_pooled(nsize))
+            return std::realloc(ptr, nsize); // NOLINT
+
+        if (is_pooled(osize) && is_pooled(nsize) && size_class(osize) == size_class(nsize))
+            return ptr;
+
+        /* Lua handles the NULL result as memory error even on shrinking */
+        void* result = allocate(nsize);
+        if (result) {
+            std::memcpy(result, ptr, osize < nsize ? osize : nsize);
+            deallocate(ptr, osize);
+        }
+        return result;
+    }
+
+    void* allocate(size_t size) noexcept {
+        if (!is_pooled(size))
+            return std::malloc(size); // NOLINT
+
+        auto  cls  = size_class(size);
+        auto& head = free_lists[cls];
+        if (head) {
+            auto node = head;
+            head      = node->next;
+            return node;
+        }
+
+        auto block_size = (cls + 1) * granularity;
+        if (size_t(chunk_end - chunk_pos) < block_size) {
+            if (!new_chunk())
+                return nullptr;
+        }
+
+        auto result = chunk_pos;
+        chunk_pos += block_size;
+        return result;
+    }
+
+    void deallocate(void* ptr, size_t size) noexcept {
+        if (!ptr)
+            return;
+
+        if (!is_pooled(size)) {
+            std::free(ptr); // NOLINT
+            return;
+        }
+
+        auto  node = static_cast<free_node*>(ptr);
+        auto& head = free_lists[size_class(size)];
+        node->next = head;
+        head       = node;
+    }
+
+    [[nodiscard]]
+    size_t chunks_count() const {
+        return chunks.size();
+    }
+
+private:
+    struct free_node {
+        free_node* next;
+    };
+
+    static constexpr bool is_pooled(size_t size) {
+        return size <= max_pooled_size;
+    }
+
+    static constexpr size_t size_class(size_t size) {
+        return (size - 1) / granularity;
+    }
+
+    bool new_chunk() noexcept {
+        auto chunk = static_cast<std::byte*>(std::malloc(chunk_size)); // NOLINT
+        if (!chunk)
+            return false;
+
+        try {
+            chunks.push_back(chunk);
+        } catch (...) {
+            std::free(chunk); // NOLINT
+            return false;
+        }
+
+        chunk_pos = chunk;
+        chunk_end = chunk + chunk_size;
+        return true;
+    }
+
+private:
+    std::array<free_node*, max_pooled_size / granularity> free_lists{};
+    std::vector<std::byte*>                                chunks;
+    std::byte*                                             chunk_pos = nullptr;
+    std::byte*                                             chunk_end = nullptr;
+};
+
+} // namespace luacpp
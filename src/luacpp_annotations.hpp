@@ -98,6 +98,8 @@ struct assist_function : public assist_value_base {
             return "number";
         if constexpr (LuaStringLike<T>)
             return "string";
+        if constexpr (std::is_same_v<T, const char*>)
+            return "string?";
         if constexpr (std::is_same_v<T, bool>)
             return "boolean";
         if constexpr (LuaRegisteredType<T>)
@@ -108,6 +110,8 @@ struct assist_function : public assist_value_base {
             return "function";
         if constexpr (LuaOptionalLike<T>)
             return get_typename<std::decay_t<decltype(*T{})>>() + '?';
+        if constexpr (LuaResultLike<T>)
+            return get_typename<typename T::value_type>();
         return "table";
     }
 
@@ -372,6 +376,13 @@ private:
             .first->second.get();
     }
 
+    template <LuaTypedArray T>
+    assist_value_base* provide_value_impl(const auto& name, const std::string&, assist_table* table) {
+        auto type = std::string("typed_array<") + typed_array_traits<typename T::value_type>::name + ">";
+        return table->values.insert_or_assign(name, std::make_unique<assist_value>(get_type(type), name))
+            .first->second.get();
+    }
+
     template <typename... Ts>
         requires(sizeof...(Ts) == 0) || ((LuaTupleLike<Ts> || LuaListLike<Ts>) && ... && true)
     assist_value_base* provide_value_impl(const auto& name, const std::string&, assist_table* table) {
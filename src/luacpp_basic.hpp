@@ -3,6 +3,7 @@
 #include <tuple>
 #include <string>
 #include <cstdint>
+#include <type_traits>
 
 #include "luacpp_integral_constant.hpp"
 
@@ -222,12 +223,39 @@ struct lua_tname {
 // template <typename T, T... Cs>
 // constexpr lua_tname<Cs...> operator""_tname() { return {}; }
 
-template <typename Type, auto LuaName>
+/* Finalizer of the usertype userdata
+ * automatic: __gc calls the destructor only if the type is not trivially destructible
+ * no_gc:     __gc is never installed, the destructor is not called
+ * force_gc:  __gc is always installed
+ * The userdata owning std::shared_ptr or intrusive_ref are released by __gc regardless of this option:
+ * without the finalizer __gc is installed at the first push of such userdata, it skips the values
+ */
+enum class usertype_gc { automatic, no_gc, force_gc };
+
+/* ffi_struct: under LuaJIT the values may be represented by FFI cdata (see luaregister_ffi_struct) */
+struct typespec_options {
+    usertype_gc gc         = usertype_gc::automatic;
+    bool        ffi_struct = false;
+};
+
+template <typename Type, auto LuaName, typespec_options Options = typespec_options{}>
 struct typespec {
     constexpr Type type() const;
     constexpr auto lua_name() const {
         return LuaName;
     }
+    static constexpr typespec_options options() {
+        return Options;
+    }
+    static constexpr bool has_ffi_struct() {
+        return Options.ffi_struct;
+    }
+    static constexpr bool has_gc() {
+        if constexpr (Options.gc == usertype_gc::automatic)
+            return !std::is_trivially_destructible_v<Type>;
+        else
+            return Options.gc == usertype_gc::force_gc;
+    }
 };
 
 namespace details
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+
+#include "luacpp_lib.hpp"
+
+namespace luacpp
+{
+
+namespace details
+{
+    inline uint64_t _fnv1a(std::string_view data, uint64_t hsh = 14695981039346656037ULL) {
+        for (auto c : data) {
+            hsh ^= uint8_t(c);
+            hsh *= 1099511628211ULL;
+        }
+        return hsh;
+    }
+
+    inline std::optional<std::string> _read_file(const std::filesystem::path& path) {
+        auto file = std::ifstream(path, std::ios::binary);
+        if (!file)
+            return {};
+
+        std::string result;
+        file.seekg(0, std::ios::end);
+        auto size = file.tellg();
+        if (size > 0) {
+            result.resize(size_t(size));
+            file.seekg(0, std::ios::beg);
+            file.read(result.data(), size);
+        }
+        if (!file)
+            return {};
+
+        return result;
+    }
+} // namespace details
+
+/* On-disk cache of compiled lua chunks
+ * The cache entry is keyed by the source path and validated by the source content hash and size,
+ * the lua variant/version (LUACPP_LUA_VARIANT, LUA_VERSION_NUM) and the pointer size.
+ * Any mismatch or broken entry leads to recompilation from the source and rewriting of the entry
+ */
+class bytecode_cache {
+public:
+    static constexpr std::string_view magic          = "LUACPPBC";
+    static constexpr uint32_t         format_version = 1;
+
+    explicit bytecode_cache(std::filesystem::path cache_directory): directory(std::move(cache_directory)) {}
+
+    /* Pushes the compiled chunk onto the stack.
+     * Returns the status of the source loading (the error message is pushed on failure)
+     */
+    int load(lua_State* l, const std::string& path, std::string_view source) {
+        auto key       = absolute_key(path);
+        auto entry     = entry_path(key);
+        auto chunkname = "@" + path;
+        auto header    = make_header(key, source);
+
+        if (auto cached = details::_read_file(entry); cached && cached->starts_with(header)) {
+            auto bytecode = std::string_view(*cached).substr(header.size());
+            if (luaload_binary(l, bytecode.data(), bytecode.size(), chunkname.data()) == 0)
+                return 0;
+            lua_pop(l, 1);
+        }
+
+        auto rc = luaL_loadbuffer(l, source.data(), source.size(), chunkname.data());
+        if (rc == 0)
+            store(l, entry, header);
+
+        return rc;
+    }
+
+    [[nodiscard]]
+    const std::filesystem::path& cache_directory() const {
+        return directory;
+    }
+
+    [[nodiscard]]
+    std::filesystem::path entry_path(const std::string& source_path) const {
+        auto name = std::to_string(details::_fnv1a(absolute_key(source_path))) + ".luac";
+        return directory / name;
+    }
+
+private:
+    static std::string absolute_key(const std::string& path) {
+        std::error_code ec;
+        auto            abs = std::filesystem::absolute(path, ec);
+        return ec ? path : abs.lexically_normal().string();
+    }
+
+    static void append(std::string& str, uint64_t value) {
+        char buff[sizeof(value)];
+        std::memcpy(buff, &value, sizeof(value));
+        str.append(buff, sizeof(buff));
+    }
+
+    static void append(std::string& str, std::string_view value) {
+        append(str, uint64_t(value.size()));
+        str.append(value);
+    }
+
+    static std::string make_header(const std::string& key, std::string_view source) {
+        std::string header{magic};
+        append(header, format_version);
+        append(header, LUACPP_LUA_VARIANT);
+        append(header, uint64_t(LUA_VERSION_NUM));
+        append(header, uint64_t(sizeof(void*)));
+        append(header, key);
+        append(header, uint64_t(source.size()));
+        append(header, details::_fnv1a(source));
+        return header;
+    }
+
+    static int writer(lua_State*, const void* data, size_t size, void* userdata) {
+        static_cast<std::string*>(userdata)->append(static_cast<const char*>(data), size);
+        return 0;
+    }
+
+    static std::filesystem::path temp_path(const std::filesystem::path& entry) {
+        static std::atomic<uint64_t> counter{0};
+
+        uint64_t suffix = 0;
+        try {
+            std::random_device random;
+            suffix = (uint64_t(random()) << 32) | uint64_t(random());
+        } catch (const std::exception&) {
+            /* No entropy source: the collisions are rejected by the exclusive create */
+        }
+
+        auto tmp = entry;
+        tmp += ".tmp" + std::to_string(suffix) + '.' + std::to_string(counter.fetch_add(1, std::memory_order_relaxed));
+        return tmp;
+    }
+
+    /* Best effort: the chunk stays on the stack, the failures are ignored */
+    void store(lua_State* l, const std::filesystem::path& entry, std::string content) const {
+        if (luadump(l, &writer, &content) != 0)
+            return;
+
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+
+        /* Write and rename, so other processes never read a partial entry.
+         * The temporary file is created exclusively ("x" mode) under the random name,
+         * so the concurrent writers of the same entry never share it
+         */
+        auto tmp  = temp_path(entry);
+        auto file = std::fopen(tmp.string().c_str(), "wbx");
+        if (!file)
+            return;
+        bool written = std::fwrite(content.data(), 1, content.size(), file) == content.size();
+        if (std::fclose(file) != 0 || !written) {
+            std::filesystem::remove(tmp, ec);
+            return;
+        }
+
+        std::filesystem::rename(tmp, entry, ec);
+        if (ec)
+            std::filesystem::remove(tmp, ec);
+    }
+
+private:
+    std::filesystem::path directory;
+};
+
+} // namespace luacpp
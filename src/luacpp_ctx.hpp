@@ -1,7 +1,15 @@
 #pragma once
 
+#include <cstdio>
+#include <cstring>
+
 #include "luacpp_details.hpp"
 #include "luacpp_member_table.hpp"
+#include "luacpp_allocator.hpp"
+#include "luacpp_bytecode_cache.hpp"
+#include "luacpp_mapped_file.hpp"
+#include "luacpp_typed_array.hpp"
+#include "luacpp_ffi.hpp"
 //#include "luacpp_assist_gen.hpp"
 #include "luacpp_annotations.hpp"
 
@@ -34,10 +42,76 @@ namespace errors
     };
 } // namespace errors
 
+namespace details
+{
+    /* The panic and the warning handlers of luaL_newstate, lua_newstate does not install them */
+    inline int _lua_panic(lua_State* l) {
+        auto message = lua_type(l, -1) == LUA_TSTRING ? lua_tostring(l, -1) : "error object is not a string";
+        std::fprintf(stderr, "PANIC: unprotected error in call to Lua API (%s)\n", message);
+        std::fflush(stderr);
+        return 0;
+    }
+
+#if LUA_VERSION_NUM >= 504
+    inline void _lua_warn_on(void* ud, const char* message, int tocont);
+    inline void _lua_warn_off(void* ud, const char* message, int tocont);
+
+    /* "@on" and "@off" switch the warnings */
+    inline bool _lua_warn_control(lua_State* l, const char* message, int tocont) {
+        if (tocont || *message != '@')
+            return false;
+        if (std::strcmp(message + 1, "off") == 0)
+            lua_setwarnf(l, &_lua_warn_off, l);
+        else if (std::strcmp(message + 1, "on") == 0)
+            lua_setwarnf(l, &_lua_warn_on, l);
+        return true;
+    }
+
+    inline void _lua_warn_continue(void* ud, const char* message, int tocont) {
+        auto l = static_cast<lua_State*>(ud);
+        std::fputs(message, stderr);
+        if (tocont)
+            lua_setwarnf(l, &_lua_warn_continue, l);
+        else {
+            std::fputs("\n", stderr);
+            std::fflush(stderr);
+            lua_setwarnf(l, &_lua_warn_on, l);
+        }
+    }
+
+    inline void _lua_warn_on(void* ud, const char* message, int tocont) {
+        if (_lua_warn_control(static_cast<lua_State*>(ud), message, tocont))
+            return;
+        std::fputs("Lua warning: ", stderr);
+        _lua_warn_continue(ud, message, tocont);
+    }
+
+    inline void _lua_warn_off(void* ud, const char* message, int tocont) {
+        _lua_warn_control(static_cast<lua_State*>(ud), message, tocont);
+    }
+#endif
+
+    /* lua_newstate with the custom allocator and the handlers of luaL_newstate (the warnings are off) */
+    inline lua_State* _lua_newstate(lua_Alloc alloc, void* ud) {
+        auto l = lua_newstate(alloc, ud);
+        if (l) {
+            lua_atpanic(l, &_lua_panic);
+#if LUA_VERSION_NUM >= 504
+            lua_setwarnf(l, &_lua_warn_off, l);
+#endif
+        }
+        return l;
+    }
+} // namespace details
+
 struct lua_code {
     std::string code;
 };
 
+/* Tag for creating luactx with the lua_pool_allocator */
+struct pooled_allocator_t {};
+inline constexpr pooled_allocator_t pooled_allocator{};
+
 class luactx {
 public:
     static auto luacpp_close(luactx* l) {
@@ -50,23 +124,17 @@ public:
     }
 
     luactx(bool generate_assist = false): l(luaL_newstate()), generate_assist_file(generate_assist) {
-        if (!l)
-            throw errors::newstate_failed();
-
-        auto guard = exception_guard{luacpp_close(this)};
-
-        luaL_openlibs(l);
-
-#ifdef WITH_LUAJIT
-        if (!luaJIT_setmode(l, 0, LUAJIT_MODE_ENGINE | LUAJIT_MODE_ON))
-            throw errors::init_error("enabling jit failed");
-#endif
-
-#if LUA_VERSION_NUM >= 504
-        lua_gc(l, LUA_GCGEN, 40, 200);
-#endif
+        init();
+    }
 
-        register_usertypes();
+    /* The state allocates through the own lua_pool_allocator instance
+     * Throws newstate_failed if the lua variant does not support custom allocators
+     */
+    luactx(pooled_allocator_t, bool generate_assist = false):
+        allocator(std::make_unique<lua_pool_allocator>()),
+        l(details::_lua_newstate(&lua_pool_allocator::alloc, allocator.get())),
+        generate_assist_file(generate_assist) {
+        init();
     }
 
     luactx(lua_State* state, bool generate_assist = false): l(state), generate_assist_file(generate_assist) {
@@ -100,29 +168,80 @@ public:
     }
 
     void load(const char* entry_file) {
-        switch (luaL_loadfile(l, entry_file)) {
-        case LUA_ERRSYNTAX:
-            throw errors::syntax_error(lua_tostring(l, -1));
-        case LUA_ERRMEM:
-            throw errors::memory_error();
-        case LUA_ERRFILE:
-            throw errors::cannot_open_file(entry_file);
+        if (bytecode_cache_storage) {
+            auto source = details::_read_file(entry_file);
+            if (!source)
+                throw errors::cannot_open_file(entry_file);
+            check_load_status(
+                bytecode_cache_storage->load(l, entry_file, details::_skip_shebang(*source)), entry_file);
         }
+        else
+            check_load_status(luaL_loadfile(l, entry_file), entry_file);
     }
 
-    void load(const lua_code& code) {
-        switch (luaL_loadstring(l, code.code.data())) {
-        case LUA_ERRSYNTAX:
-            throw errors::syntax_error(lua_tostring(l, -1));
-        case LUA_ERRMEM:
-            throw errors::memory_error();
+    /* Same as load(const char*), but the script is memory mapped and fed to lua_load without copying
+     * Pipes, devices and empty files are loaded with the regular load(const char*)
+     */
+    void load_mapped(const char* entry_file) {
+        auto file = mapped_file(entry_file);
+        if (!file.is_mapped()) {
+            load(entry_file);
+            return;
         }
+
+        auto source = details::_skip_shebang(file.view());
+        if (bytecode_cache_storage) {
+            check_load_status(bytecode_cache_storage->load(l, entry_file, source), entry_file);
+            return;
+        }
+
+        auto chunkname = std::string("@") + entry_file;
+        auto reader    = details::_view_reader{source};
+        check_load_status(luaload_reader(l, &details::_view_reader::read, &reader, chunkname.data()), entry_file);
+    }
+
+    void load(const lua_code& code) {
+        check_load_status(luaL_loadstring(l, code.code.data()), "<lua_code>");
     }
 
     void call() {
         luacall(l, 0, 0);
     }
 
+    /* Makes load(const char*) keep the compiled chunks in the cache_directory */
+    void enable_bytecode_cache(std::filesystem::path cache_directory) {
+        bytecode_cache_storage.emplace(std::move(cache_directory));
+    }
+
+    void disable_bytecode_cache() {
+        bytecode_cache_storage.reset();
+    }
+
+    /* Makes the typed_array constructors available in lua (typed_array.float32(size_or_table), ...) */
+    void provide_typed_arrays() {
+        luaprovide_typed_arrays(l);
+    }
+
+    /* Pushing the same object by borrowed, std::shared_ptr or intrusive_ref reuses its live userdata */
+    void enable_identity_cache() {
+        luaenable_identity_cache(l);
+    }
+
+    [[nodiscard]]
+    identity_cache_stats identity_cache_statistics() const {
+        return luaidentity_cache_stats(l);
+    }
+
+    /* The string is kept by the state, pushing the handle does not hash the string again */
+    [[nodiscard]]
+    interned_string intern(std::string_view str) {
+        return luaintern(l, str);
+    }
+
+    void release_interned(interned_string& str) {
+        luarelease_interned(l, str);
+    }
+
     [[nodiscard]]
     lua_State* state() const {
         return l;
@@ -135,6 +254,19 @@ public:
         return luaprovide(NameT{}, l, std::forward<T>(value));
     }
 
+    /* Binding without the argument checks for the trusted hot paths (see luaprovide_unchecked) */
+    template <typename NameT, typename F>
+    void provide_unchecked(const NameT& name, F&& function) {
+        provide_assist(name, function);
+        luaprovide_unchecked(NameT{}, l, std::forward<F>(function));
+    }
+
+    /* FFI fast path for the free functions with the C-compatible signatures (see luaprovide_ffi) */
+    template <typename NameT, typename F>
+    void provide_ffi(const NameT& name, F&& function) {
+        luaprovide_ffi(name, l, std::forward<F>(function));
+    }
+
     template <typename NameT, typename F>
     auto provide_commutative_op(NameT, F&& member_function) {
         return overloaded{
@@ -190,14 +322,15 @@ public:
     }
 
     template <typename UserType>
-    void set_member_table(member_table<UserType> table) {
+    void set_member_table(member_table<UserType> table, member_lookup lookup = member_lookup::fields_first) {
         if (generate_assist_file) {
             auto class_name = type_registry::get_typespec<UserType>().lua_name();
             for (auto& [field_name, _] : table)
                 provide_assist(class_name.dot(field_name));
         }
 
-        provide_member<UserType>(LUA_TNAME("__index"), [this, table](const UserType& data, const std::string& field) {
+        /* The field name borrows the lua string (which is null-terminated), the lookup does not allocate */
+        provide_member<UserType>(LUA_TNAME("__index"), [this, table](const UserType& data, std::string_view field) {
             auto found_field = table.find(field);
             if (found_field != table.end())
                 found_field->second.get(data, *this);
@@ -208,11 +341,12 @@ public:
 
         provide_member<UserType>(
             LUA_TNAME("__newindex"),
-            [this, table = std::move(table)](UserType& data, const std::string& field, placeholder) {
+            [this, table = std::move(table)](UserType& data, std::string_view field, placeholder) {
                 auto found_field = table.find(field);
                 if (found_field != table.end()) {
                     if (!found_field->second.set)
-                        throw errors::access_error(std::string("the field '") + field + "' of object type " +
+                        throw errors::access_error(std::string("the field '") + std::string(field) +
+                                                   "' of object type " +
                                                    type_registry::get_typespec<UserType>().lua_name().data() +
                                                    " is private");
                     found_field->second.set(data, *this);
@@ -220,20 +354,54 @@ public:
                 else
                     throw errors::access_error(std::string("object of type '") +
                                                type_registry::get_typespec<UserType>().lua_name().data() +
-                                               "' has no '" + field + "' field");
+                                               "' has no '" + std::string(field) + "' field");
             });
+
+        if (lookup == member_lookup::methods_first)
+            set_methods_first_index<UserType>();
+    }
+
+    template <typename UserType>
+    void set_member_table(interned_member_table<UserType> table, member_lookup lookup = member_lookup::fields_first) {
+        if (generate_assist_file) {
+            auto class_name = type_registry::get_typespec<UserType>().lua_name();
+            for (auto& [field_name, _] : table.fields)
+                provide_assist(class_name.dot(field_name));
+        }
+
+        auto fields = std::make_shared<const details::interned_field_map<UserType>>(l, std::move(table.fields));
+
+        /* Raw closures: the fields are resolved on the calling thread, which may be a coroutine */
+        {
+            details::_push_usertype_metatable<UserType>(l);
+            auto guard = finalizer{[this] { lua_pop(l, 1); }};
+            luapush(l, lua_closure<interned_index<UserType>>{{this, fields}});
+            lua_setfield(l, -2, "__index");
+            luapush(l, lua_closure<interned_newindex<UserType>>{{this, fields}});
+            lua_setfield(l, -2, "__newindex");
+        }
+
+        if (lookup == member_lookup::methods_first)
+            set_methods_first_index<UserType>();
     }
 
+    /* Under LuaJIT the values of UserType become FFI cdata with the given fields (see luaregister_ffi_struct) */
     template <typename UserType>
-    void set_ordered_member_table(ordered_member_table<UserType> table) {
+    bool set_ffi_struct(const ffi_struct_fields<UserType>& fields) {
+        return luaregister_ffi_struct<UserType>(l, fields);
+    }
+
+    template <typename UserType>
+    void set_ordered_member_table(ordered_member_table<UserType> table,
+                                  member_lookup                  lookup = member_lookup::fields_first) {
         member_table<UserType> tbl;
         for (auto& [k, v] : table) tbl.insert_or_assign(k, std::move(v));
-        set_member_table(std::move(tbl));
+        set_member_table(std::move(tbl), lookup);
     }
 
     template <typename UserType>
-    void set_member_table(ordered_member_table<UserType> table) {
-        set_ordered_member_table(std::move(table));
+    void set_member_table(ordered_member_table<UserType> table, member_lookup lookup = member_lookup::fields_first) {
+        set_ordered_member_table(std::move(table), lookup);
     }
 
     template <typename T, typename NameT>
@@ -301,21 +469,144 @@ public:
     }
 
 private:
+    /* Points the context to the calling thread while the getters and setters of the member table run */
+    auto switch_state(lua_State* state) {
+        auto saved = std::exchange(l, state);
+        return finalizer{[this, saved] { l = saved; }};
+    }
+
+    template <typename UserType>
+    struct interned_index {
+        int call(lua_State* state) {
+            try {
+                auto&& data = luaget<const UserType&>(state, 1);
+                if (auto field = fields->find(state, 2)) {
+                    auto switched = ctx->switch_state(state);
+                    field->get(data, *ctx);
+                }
+                else if (lua_type(state, 2) != LUA_TSTRING || !luaL_getmetafield(state, 1, lua_tostring(state, 2)))
+                    lua_pushnil(state);
+                return 1;
+            } catch (const std::exception& e) {
+                details::_push_error_message(state, e.what());
+            }
+            return lua_error(state);
+        }
+
+        luactx*                                                      ctx;
+        std::shared_ptr<const details::interned_field_map<UserType>> fields;
+    };
+
+    template <typename UserType>
+    struct interned_newindex {
+        int call(lua_State* state) {
+            try {
+                auto&& data  = luaget<UserType&>(state, 1);
+                auto   field = fields->find(state, 2);
+                if (field && field->set) {
+                    auto switched = ctx->switch_state(state);
+                    field->set(data, *ctx);
+                    return 0;
+                }
+
+                auto type_name = type_registry::get_typespec<UserType>().lua_name().data();
+                auto name = lua_type(state, 2) == LUA_TSTRING ? std::string(lua_tostring(state, 2)) : std::string("?");
+                if (field)
+                    throw errors::access_error(std::string("the field '") + name + "' of object type " + type_name +
+                                               " is private");
+                throw errors::access_error(std::string("object of type '") + type_name + "' has no '" + name +
+                                           "' field");
+            } catch (const std::exception& e) {
+                details::_push_error_message(state, e.what());
+            }
+            return lua_error(state);
+        }
+
+        luactx*                                                      ctx;
+        std::shared_ptr<const details::interned_field_map<UserType>> fields;
+    };
+
+    void init() {
+        if (!l)
+            throw errors::newstate_failed();
+
+        auto guard = exception_guard{luacpp_close(this)};
+
+        luaL_openlibs(l);
+
+#ifdef WITH_LUAJIT
+        if (!luaJIT_setmode(l, 0, LUAJIT_MODE_ENGINE | LUAJIT_MODE_ON))
+            throw errors::init_error("enabling jit failed");
+#endif
+
+#if LUA_VERSION_NUM >= 504
+        lua_gc(l, LUA_GCGEN, 40, 200);
+#endif
+
+        register_usertypes();
+    }
+
+    void check_load_status(int rc, const char* chunk_name) {
+        switch (rc) {
+        case LUA_ERRSYNTAX:
+            throw errors::syntax_error(lua_tostring(l, -1));
+        case LUA_ERRMEM:
+            throw errors::memory_error();
+        case LUA_ERRFILE:
+            throw errors::cannot_open_file(chunk_name);
+        }
+    }
+
     void register_usertypes() {
         tforeach<typespec_list<0>>([this](auto typespec) {
             using type = decltype(typespec.type());
-            provide_member<type>(LUA_TNAME("__gc"), [](type* userdata) { userdata->~type(); });
 
             lua_getglobal(l, typespec.lua_name().data());
+            if (lua_isnil(l, -1)) {
+                lua_pop(l, 1);
+                lua_newtable(l);
+                lua_pushvalue(l, -1);
+                lua_setglobal(l, typespec.lua_name().data());
+            }
+            if constexpr (decltype(typespec)::has_gc()) {
+                lua_pushcfunction(l, &details::_usertype_gc<type>);
+                lua_setfield(l, -2, "__gc");
+            }
             lua_pushvalue(l, -1);
             lua_setfield(l, -2, "__index");
-            lua_pop(l, 1);
+            luaregistry_set(l, &details::usertype_metatable_key<type>);
 
             if constexpr (requires { usertype_method_loader<type>(); })
                 usertype_method_loader<type>()(*this);
         });
     }
 
+    /* Replaces the C++ __index with the lua function, which returns the methods from the metatable
+     * and calls the C++ field resolver only for the other keys
+     */
+    template <typename UserType>
+    void set_methods_first_index() {
+        static constexpr auto methods_first_index = R"(
+            local methods, resolve = ...
+            return function(self, key)
+                local method = methods[key]
+                if method ~= nil then
+                    return method
+                end
+                return resolve(self, key)
+            end
+        )";
+
+        details::_push_usertype_metatable<UserType>(l);
+        auto guard = finalizer{[this] { lua_pop(l, 1); }};
+
+        check_load_status(luaL_loadstring(l, methods_first_index), "methods_first_index");
+        lua_pushvalue(l, -2);
+        lua_getfield(l, -3, "__index");
+        lua_call(l, 2, 1);
+        lua_setfield(l, -2, "__index");
+    }
+
     bool assist_allowed(const auto& name) {
         std::string n = name;
         return generate_assist_file && !(n.ends_with("__gc") || n.ends_with("__index") || n.ends_with("__newindex"));
@@ -354,10 +645,12 @@ private:
     }
 
 private:
-    lua_State* l;
+    std::unique_ptr<lua_pool_allocator> allocator;
+    lua_State*                          l;
 
-    annotator annot;
-    bool      generate_assist_file = false;
+    annotator                     annot;
+    bool                          generate_assist_file = false;
+    std::optional<bytecode_cache> bytecode_cache_storage;
 };
 
 } // namespace luacpp
@@ -1,11 +1,20 @@
 #pragma once
 
+#include <array>
+#include <cmath>
+#include <functional>
+#include <limits>
 #include <stdexcept>
 #include <string>
 #include <tuple>
 #include <type_traits>
+#include <utility>
 #include <optional>
+#include <ranges>
+#include <span>
 #include <iostream>
+#include <memory>
+#include <variant>
 
 #include "luacpp_lib.hpp"
 #include "luacpp_usertype_registry.hpp"
@@ -99,8 +108,81 @@ concept LuaPushBackable = !LuaStringLike<T> && requires(T & v) {
 template <typename T>
 concept LuaPushBackableOrRef = LuaPushBackable<std::decay_t<T>>;
 
+/* Element types of luacpp::typed_array
+ * Userdata layout is [typed_array_header][elements], the tag identifies the element type
+ */
+struct typed_array_header {
+    uint64_t tag;
+    uint64_t size;
+};
+
+template <typename T>
+struct typed_array_traits;
+
+template <>
+struct typed_array_traits<float> {
+    static constexpr uint64_t tag     = 0x4c43544100000001;
+    static constexpr char     name[]  = "float32";
+    static constexpr char     ctype[] = "float";
+};
+
+template <>
+struct typed_array_traits<double> {
+    static constexpr uint64_t tag     = 0x4c43544100000002;
+    static constexpr char     name[]  = "float64";
+    static constexpr char     ctype[] = "double";
+};
+
+template <>
+struct typed_array_traits<int32_t> {
+    static constexpr uint64_t tag     = 0x4c43544100000003;
+    static constexpr char     name[]  = "int32";
+    static constexpr char     ctype[] = "int32_t";
+};
+
+template <>
+struct typed_array_traits<int64_t> {
+    static constexpr uint64_t tag     = 0x4c43544100000004;
+    static constexpr char     name[]  = "int64";
+    static constexpr char     ctype[] = "int64_t";
+};
+
+template <>
+struct typed_array_traits<uint8_t> {
+    static constexpr uint64_t tag     = 0x4c43544100000005;
+    static constexpr char     name[]  = "uint8";
+    static constexpr char     ctype[] = "uint8_t";
+};
+
+template <typename T>
+concept LuaTypedArrayElement = requires { typed_array_traits<T>::tag; };
+
+/* std::span<T> (or std::span<const T>) view of the typed_array userdata */
+template <typename T>
+concept LuaTypedArraySpan = requires { typename T::element_type; } &&
+                            std::same_as<T, std::span<typename T::element_type>> &&
+                            LuaTypedArrayElement<std::remove_const_t<typename T::element_type>>;
+
+template <typename T>
+concept LuaTypedArraySpanOrRef = LuaTypedArraySpan<std::decay_t<T>>;
+
+template <LuaTypedArrayElement T>
+struct typed_array;
+
+template <typename T>
+concept LuaTypedArray = LuaTypedArrayElement<typename T::value_type> && std::same_as<T, typed_array<typename T::value_type>>;
+
 template <typename T>
-concept LuaStaticSettable = !LuaTupleLike<T> && !LuaStringLike<T> && !LuaPushBackable<T> && requires(T & v) {
+concept LuaRegisteredSharedPtr = requires { typename T::element_type; } &&
+                                 std::same_as<T, std::shared_ptr<typename T::element_type>> &&
+                                 LuaRegisteredType<typename T::element_type>;
+
+template <typename T>
+concept LuaRegisteredSharedPtrOrRef = LuaRegisteredSharedPtr<std::decay_t<T>>;
+
+template <typename T>
+concept LuaStaticSettable = !LuaTupleLike<T> && !LuaStringLike<T> && !LuaPushBackable<T> && !LuaTypedArraySpan<T> &&
+                            requires(T & v) {
     {v[0] = v[0]};
     { size(v) } -> std::convertible_to<size_t>;
 } && !LuaRegisteredType<T> && !LuaMapLike<T>;
@@ -108,6 +190,13 @@ concept LuaStaticSettable = !LuaTupleLike<T> && !LuaStringLike<T> && !LuaPushBac
 template <typename T>
 concept LuaStaticSettableOrRef = LuaStaticSettable<std::decay_t<T>>;
 
+/* Contiguous containers of numbers (std::vector<double>, std::array<int, N>, ...)
+ * These are converted with the presized raw indexed access
+ */
+template <typename T>
+concept LuaNumberArray = !LuaStringLike<T> && !LuaRegisteredType<T> && std::ranges::contiguous_range<const T> &&
+                         LuaNumber<std::ranges::range_value_t<T>>;
+
 
 /* Forward declarations */
 
@@ -123,6 +212,12 @@ template <typename T>
     requires LuaRegisteredType<std::decay_t<T>>
 std::decay_t<T>* luapush(lua_State* l, T&& value);
 
+template <typename S>
+struct lua_closure;
+
+template <typename S>
+void luapush(lua_State* l, lua_closure<S>&& closure);
+
 template <LuaPushBackableOrRef T>
 auto luaget(lua_State* l, int idx);
 
@@ -145,6 +240,18 @@ bool luacheck(lua_State* l, int idx);
 template <LuaTupleLikeOrRef T>
 bool luacheck(lua_State* l, int idx);
 
+template <LuaTypedArraySpanOrRef T>
+std::decay_t<T> luaget(lua_State* l, int idx);
+
+template <LuaTypedArraySpanOrRef T>
+bool luacheck(lua_State* l, int idx);
+
+template <LuaRegisteredSharedPtrOrRef T>
+std::decay_t<T> luaget(lua_State* l, int idx);
+
+template <LuaRegisteredSharedPtrOrRef T>
+bool luacheck(lua_State* l, int idx);
+
 
 /* Push functions */
 
@@ -193,6 +300,58 @@ void luapush(lua_State* l, const LuaStringLike auto& value) {
     lua_pushlstring(l, std::string_view(value).data(), std::string_view(value).size());
 }
 
+/* Handle of the string interned in the lua state with luaintern
+ * The string is kept in the registry, luapush is a raw indexed fetch without hashing the string again.
+ * The handle is valid only for the state it was created for, until luarelease_interned is called
+ */
+struct interned_string {
+    int ref = LUA_NOREF;
+};
+
+inline interned_string luaintern(lua_State* l, std::string_view str) {
+    lua_pushlstring(l, str.data(), str.size());
+    return {luaL_ref(l, LUA_REGISTRYINDEX)};
+}
+
+inline void luarelease_interned(lua_State* l, interned_string& str) {
+    luaL_unref(l, LUA_REGISTRYINDEX, str.ref);
+    str.ref = LUA_NOREF;
+}
+
+inline void luapush(lua_State* l, interned_string str) {
+    lua_rawgeti(l, LUA_REGISTRYINDEX, str.ref);
+}
+
+namespace details
+{
+    /* Compile-time names are interned once per state and fetched from the registry by the address of their
+     * static storage. Other names are pushed with lua_pushlstring
+     */
+    template <char... Cs>
+    void _push_name(lua_State* l, lua_tname<Cs...>) {
+        constexpr const void* key = lua_tname<Cs...>::_storage;
+
+        luaregistry_get(l, key);
+        if (lua_type(l, -1) == LUA_TSTRING)
+            return;
+        lua_pop(l, 1);
+
+        lua_pushlstring(l, lua_tname<Cs...>::_storage, sizeof...(Cs));
+        lua_pushvalue(l, -1);
+        luaregistry_set(l, key);
+    }
+
+    template <typename TName>
+    void _push_name(lua_State* l, const TName& name) {
+        lua_pushlstring(l, name.data(), name.size());
+    }
+} // namespace details
+
+template <char... Cs>
+void luapush(lua_State* l, lua_tname<Cs...> name) {
+    details::_push_name(l, name);
+}
+
 void luapush(lua_State* l, const auto* pointer_value) {
     if (!pointer_value)
         lua_pushnil(l);
@@ -217,7 +376,29 @@ void luapush(lua_State* l, const LuaMapLike auto& value) {
     }
 }
 
+namespace details
+{
+    /* Bulk path for LuaNumberArray: presized table filled with lua_rawseti */
+    template <typename T>
+    void _number_array_push(lua_State* l, const T* data, size_t size) {
+        lua_createtable(l, int(size), 0);
+        if (!lua_checkstack(l, 1)) {
+            lua_pop(l, 1);
+            throw errors::stack_overflow();
+        }
+        for (size_t i = 0; i < size; ++i) {
+            luapush(l, data[i]);
+            lua_rawseti(l, -2, int(i + 1));
+        }
+    }
+} // namespace details
+
 void luapush(lua_State* l, const LuaListLike auto& value) {
+    if constexpr (LuaNumberArray<std::decay_t<decltype(value)>>) {
+        details::_number_array_push(l, std::ranges::data(value), std::ranges::size(value));
+        return;
+    }
+
     auto b = begin(value);
     auto e = end(value);
 
@@ -234,13 +415,352 @@ void luapush(lua_State* l, const LuaListLike auto& value) {
 }
 
 void luapush(lua_State* l, const LuaTupleLike auto& value) {
-    lua_createtable(l, int(std::tuple_size_v<std::decay_t<decltype(value)>>), 0);
-    []<size_t... Idxs>([[maybe_unused]] lua_State * l, decltype(value) value, std::index_sequence<Idxs...>) {
-        ((lua_pushnumber(l, int(Idxs) + 1), luapush(l, std::get<Idxs>(value)), lua_settable(l, -3)), ...);
+    if constexpr (LuaNumberArray<std::decay_t<decltype(value)>>) {
+        details::_number_array_push(l, std::ranges::data(value), std::ranges::size(value));
+    }
+    else {
+        lua_createtable(l, int(std::tuple_size_v<std::decay_t<decltype(value)>>), 0);
+        []<size_t... Idxs>([[maybe_unused]] lua_State * l, decltype(value) value, std::index_sequence<Idxs...>) {
+            ((lua_pushnumber(l, int(Idxs) + 1), luapush(l, std::get<Idxs>(value)), lua_settable(l, -3)), ...);
+        }
+        (l, value, std::make_index_sequence<std::tuple_size_v<std::decay_t<decltype(value)>>>());
+    }
+}
+
+namespace details
+{
+    /* The address of this variable is the registry key of the T metatable */
+    template <typename T>
+    inline constexpr char usertype_metatable_key = 0;
+
+    /* Metatables are stored in the registry by luactx::register_usertypes,
+     * the global table is used for the states without registered usertypes
+     */
+    template <typename T>
+    void _push_usertype_metatable(lua_State* l) {
+        luaregistry_get(l, &usertype_metatable_key<T>);
+        if (lua_isnil(l, -1)) {
+            lua_pop(l, 1);
+            lua_getglobal(l, type_registry::get_typespec<T>().lua_name().data());
+        }
+    }
+
+    /* LuaJIT cdata type, it is not in the public API */
+    inline constexpr int lua_tcdata = 10;
+
+    /* Registry keys of the FFI ctype of T and its ffi.istype check function */
+    template <typename T>
+    inline constexpr char ffi_struct_ctype_key = 0;
+
+    template <typename T>
+    inline constexpr char ffi_struct_istype_key = 0;
+
+    template <typename T>
+    constexpr bool ffi_struct_enabled() {
+#ifdef WITH_LUAJIT
+        return decltype(type_registry::get_typespec<T>())::has_ffi_struct();
+#else
+        return false;
+#endif
+    }
+
+    /* Pushes the zero-initialized cdata of T, if luaregister_ffi_struct was called for this state */
+    template <typename T>
+    T* _push_ffi_struct(lua_State* l) {
+        luaregistry_get(l, &ffi_struct_ctype_key<T>);
+        if (lua_isnil(l, -1)) {
+            lua_pop(l, 1);
+            return nullptr;
+        }
+        lua_call(l, 0, 1);
+        return static_cast<T*>(const_cast<void*>(lua_topointer(l, -1))); // NOLINT
+    }
+
+    /* Usertype userdata layout: [uint64_t type index][padding][T]
+     * Lua aligns the userdata blocks at least to 8 bytes, the padding is reserved only for the over-aligned types,
+     * so the payload of the T with alignof(T) <= 8 is placed right after the type index
+     */
+    template <typename T>
+    struct usertype_layout {
+        static constexpr size_t block_alignment = alignof(uint64_t);
+        static constexpr size_t padding         = alignof(T) > block_alignment ? alignof(T) - block_alignment : 0;
+        static constexpr size_t size            = sizeof(uint64_t) + padding + sizeof(T);
+
+        static void* payload(void* block) {
+            auto address = reinterpret_cast<uintptr_t>(block) + sizeof(uint64_t); // NOLINT
+            if constexpr (padding > 0)
+                address = (address + alignof(T) - 1) & ~uintptr_t(alignof(T) - 1);
+            return reinterpret_cast<void*>(address); // NOLINT
+        }
+    };
+
+    /* Storage kind of the usertype userdata, kept in the high bits of the type index
+     * value:     [type index][padding][T]
+     * borrowed:  [type index | borrowed][T*][generation pointer][generation]
+     * shared:    [type index | shared][std::shared_ptr<T>]
+     * intrusive: [type index | intrusive][T*], the reference is retained by the userdata
+     */
+    enum class usertype_storage : uint64_t {
+        value     = 0,
+        borrowed  = uint64_t(1) << 63,
+        shared    = uint64_t(1) << 62,
+        intrusive = uint64_t(1) << 61,
+    };
+
+    inline constexpr uint64_t usertype_storage_mask = uint64_t(usertype_storage::borrowed) |
+                                                      uint64_t(usertype_storage::shared) |
+                                                      uint64_t(usertype_storage::intrusive);
+
+    struct borrowed_block {
+        uint64_t        type_index;
+        void*           ptr;
+        const uint64_t* generation;
+        uint64_t        generation_value;
+    };
+
+    template <typename T>
+    struct shared_block {
+        uint64_t           type_index;
+        std::shared_ptr<T> ptr;
+    };
+
+    struct intrusive_block {
+        uint64_t type_index;
+        void*    ptr;
+    };
+
+    /* The userdata at idx must be checked with lua_type before */
+    inline uint64_t _usertype_header(lua_State* l, int idx) {
+        uint64_t header = 0;
+        if (lua_objlen(l, idx) >= sizeof(header))
+            std::memcpy(&header, lua_touserdata(l, idx), sizeof(header));
+        return header;
+    }
+
+    inline usertype_storage _usertype_storage(uint64_t header) {
+        return usertype_storage(header & usertype_storage_mask);
+    }
+
+    template <typename T>
+    size_t _usertype_block_size(usertype_storage storage) {
+        switch (storage) {
+        case usertype_storage::borrowed: return sizeof(borrowed_block);
+        case usertype_storage::shared: return sizeof(shared_block<T>);
+        case usertype_storage::intrusive: return sizeof(intrusive_block);
+        default: return usertype_layout<T>::size;
+        }
+    }
+
+    /* Pointer to the object, the block must be checked before */
+    template <typename T>
+    T* _usertype_object(void* block, usertype_storage storage) {
+        switch (storage) {
+        case usertype_storage::borrowed: return static_cast<T*>(static_cast<borrowed_block*>(block)->ptr);
+        case usertype_storage::shared: return static_cast<shared_block<T>*>(block)->ptr.get();
+        case usertype_storage::intrusive: return static_cast<T*>(static_cast<intrusive_block*>(block)->ptr);
+        default: return static_cast<T*>(usertype_layout<T>::payload(block));
+        }
     }
-    (l, value, std::make_index_sequence<std::tuple_size_v<std::decay_t<decltype(value)>>>());
+
+    inline bool _borrowed_is_expired(const borrowed_block* block) {
+        return block->generation && *block->generation != block->generation_value;
+    }
+
+    template <typename T>
+    int _usertype_gc(lua_State* l);
+
+    /* Metatable of the userdata, which own a reference (shared and intrusive storages)
+     * If T has no finalizer, __gc is installed on T metatable at the first owning push, so the metamethods
+     * (including the ones assigned from lua later) and getmetatable are shared with the values.
+     * The values and the borrowed references of such T are not destroyed by it (see _usertype_destroy)
+     */
+    template <typename T>
+    void _push_usertype_ref_metatable(lua_State* l) {
+        _push_usertype_metatable<T>(l);
+        if constexpr (!type_registry::get_typespec<T>().has_gc()) {
+            if (!lua_istable(l, -1))
+                return;
+            lua_pushstring(l, "__gc");
+            lua_rawget(l, -2);
+            bool installed = !lua_isnil(l, -1);
+            lua_pop(l, 1);
+            if (!installed) {
+                lua_pushcfunction(l, &_usertype_gc<T>);
+                lua_setfield(l, -2, "__gc");
+            }
+        }
+    }
+
+    /* The finalizer is chosen by the storage kind: the owning references are always released */
+    template <typename T>
+    void _push_usertype_block(lua_State* l, size_t size, usertype_storage storage, auto&& construct) {
+        void* block      = lua_newuserdata(l, size);
+        auto  type_index = type_registry::get_index<T>() | uint64_t(storage);
+        std::memcpy(block, &type_index, sizeof(type_index));
+        construct(block);
+        if (storage == usertype_storage::shared || storage == usertype_storage::intrusive)
+            _push_usertype_ref_metatable<T>(l);
+        else
+            _push_usertype_metatable<T>(l);
+        lua_setmetatable(l, -2);
+    }
+} // namespace details
+
+/* Counters of the identity cache (see luaenable_identity_cache) */
+struct identity_cache_stats {
+    uint64_t hits   = 0;
+    uint64_t misses = 0;
+};
+
+namespace details
+{
+    /* registry[&identity_cache_key] is the stats userdata (the cache is enabled if it exists),
+     * registry[&identity_cache_table_key] is the table: type index -> weak-valued table: object address -> userdata.
+     * The objects of different types may share the address (a struct and its first member)
+     */
+    inline constexpr char identity_cache_key       = 0;
+    inline constexpr char identity_cache_table_key = 0;
+
+    enum class identity_cache_result { disabled, hit, miss };
+
+    /* Pushes the cached userdata on hit, the stack is unchanged otherwise.
+     * The cached userdata must have the same type and storage kind and refer the object the same way
+     */
+    template <typename T>
+    identity_cache_result
+    _identity_cache_lookup(lua_State* l, const void* address, usertype_storage storage, auto&& same_reference) {
+        luaregistry_get(l, &identity_cache_key);
+        auto stats = static_cast<identity_cache_stats*>(lua_touserdata(l, -1));
+        lua_pop(l, 1);
+        if (!stats)
+            return identity_cache_result::disabled;
+
+        luaregistry_get(l, &identity_cache_table_key);
+        lua_rawgeti(l, -1, int(type_registry::get_index<T>()));
+        lua_remove(l, -2);
+        if (!lua_istable(l, -1)) {
+            lua_pop(l, 1);
+            ++stats->misses;
+            return identity_cache_result::miss;
+        }
+
+        lua_pushlightuserdata(l, const_cast<void*>(address)); // NOLINT
+        lua_rawget(l, -2);
+
+        if (lua_type(l, -1) == LUA_TUSERDATA && lua_objlen(l, -1) == _usertype_block_size<T>(storage) &&
+            _usertype_header(l, -1) == (type_registry::get_index<T>() | uint64_t(storage)) &&
+            same_reference(lua_touserdata(l, -1))) {
+            lua_remove(l, -2);
+            ++stats->hits;
+            return identity_cache_result::hit;
+        }
+
+        lua_pop(l, 2);
+        ++stats->misses;
+        return identity_cache_result::miss;
+    }
+
+    /* Caches the userdata on the top of the stack, the table of T is created at the first store */
+    template <typename T>
+    void _identity_cache_store(lua_State* l, const void* address) {
+        constexpr auto type_index = int(type_registry::get_index<T>());
+
+        luaregistry_get(l, &identity_cache_table_key);
+        lua_rawgeti(l, -1, type_index);
+        if (!lua_istable(l, -1)) {
+            lua_pop(l, 1);
+            lua_newtable(l);
+            lua_createtable(l, 0, 1);
+            lua_pushstring(l, "v");
+            lua_setfield(l, -2, "__mode");
+            lua_setmetatable(l, -2);
+            lua_pushvalue(l, -1);
+            lua_rawseti(l, -3, type_index);
+        }
+
+        lua_pushlightuserdata(l, const_cast<void*>(address)); // NOLINT
+        lua_pushvalue(l, -4);
+        lua_rawset(l, -3);
+        lua_pop(l, 2);
+    }
+
+    /* Push of the non-copying storage kinds, reuses the cached userdata of the same object if the cache is enabled */
+    template <typename T>
+    void _push_referencing_usertype_block(lua_State*       l,
+                                          const void*      address,
+                                          size_t           size,
+                                          usertype_storage storage,
+                                          auto&&           same_reference,
+                                          auto&&           construct) {
+        auto cached = _identity_cache_lookup<T>(l, address, storage, same_reference);
+        if (cached == identity_cache_result::hit)
+            return;
+
+        _push_usertype_block<T>(l, size, storage, construct);
+
+        if (cached == identity_cache_result::miss)
+            _identity_cache_store<T>(l, address);
+    }
+} // namespace details
+
+/* Enables the per-state identity cache: pushing the same object by borrowed, std::shared_ptr or intrusive_ref
+ * gives the same userdata while it is alive. The values are weak, so the cache does not prolong the userdata lifetime
+ */
+inline void luaenable_identity_cache(lua_State* l) {
+    luaregistry_get(l, &details::identity_cache_key);
+    bool enabled = !lua_isnil(l, -1);
+    lua_pop(l, 1);
+    if (enabled)
+        return;
+
+    lua_newtable(l);
+    luaregistry_set(l, &details::identity_cache_table_key);
+
+    new (lua_newuserdata(l, sizeof(identity_cache_stats))) identity_cache_stats{};
+    luaregistry_set(l, &details::identity_cache_key);
+}
+
+inline identity_cache_stats luaidentity_cache_stats(lua_State* l) {
+    luaregistry_get(l, &details::identity_cache_key);
+    auto stats = static_cast<const identity_cache_stats*>(lua_touserdata(l, -1));
+    lua_pop(l, 1);
+    return stats ? *stats : identity_cache_stats{};
+}
+
+/* Non-owning reference to the object of the registered type
+ * luapush stores only the pointer, no copy is made and the destructor is never called by lua.
+ * The object must outlive all the lua references to it, or the generation counter must be given:
+ * the reference expires when the counter changes, access through the expired reference raises the cast_error
+ */
+template <LuaRegisteredType T>
+struct borrowed {
+    T*              ptr;
+    const uint64_t* generation = nullptr;
+};
+
+template <LuaRegisteredType T>
+borrowed<T> borrow(T& value) {
+    return {&value};
+}
+
+template <LuaRegisteredType T>
+borrowed<T> borrow(T& value, const uint64_t& generation) {
+    return {&value, &generation};
 }
 
+/* Intrusive reference counting policy, found by ADL (the same functions as used by boost::intrusive_ptr) */
+template <typename T>
+concept LuaIntrusiveRefcounted = requires(T* ptr) {
+    intrusive_ptr_add_ref(ptr);
+    intrusive_ptr_release(ptr);
+};
+
+/* Object with the intrusive reference counter, luapush retains the reference until the userdata is collected */
+template <typename T> requires LuaRegisteredType<T> && LuaIntrusiveRefcounted<T>
+struct intrusive_ref {
+    T* ptr;
+};
+
 template <typename T> requires LuaRegisteredType<std::decay_t<T>>
 std::decay_t<T>* luapush(lua_State* l, T&& value) {
     if constexpr (std::is_pointer_v<std::decay_t<T>>) {
@@ -250,17 +770,96 @@ std::decay_t<T>* luapush(lua_State* l, T&& value) {
         }
     }
 
-    void*    p          = lua_newuserdata(l, sizeof(uint64_t) + sizeof(value));
+    if constexpr (details::ffi_struct_enabled<std::decay_t<T>>()) {
+        if (auto cdata = details::_push_ffi_struct<std::decay_t<T>>(l))
+            return new (cdata) std::decay_t<T>(std::forward<T>(value)); // NOLINT
+    }
+
+    using layout = details::usertype_layout<std::decay_t<T>>;
+
+    void*    p          = lua_newuserdata(l, layout::size);
     uint64_t type_index = type_registry::get_index<std::decay_t<T>>();
     std::memcpy(p, &type_index, sizeof(type_index));
-    void* data = reinterpret_cast<char*>(p) + sizeof(uint64_t);      // NOLINT
-    auto  ptr  = new (data) std::decay_t<T>(std::forward<T>(value)); // NOLINT
-    lua_getglobal(l, type_registry::get_typespec<std::decay_t<T>>().lua_name().data());
+    auto ptr = new (layout::payload(p)) std::decay_t<T>(std::forward<T>(value)); // NOLINT
+    details::_push_usertype_metatable<std::decay_t<T>>(l);
     lua_setmetatable(l, -2);
 
     return ptr;
 }
 
+template <LuaRegisteredType T>
+T* luapush(lua_State* l, const borrowed<T>& value) {
+    if (!value.ptr) {
+        luapush(l, nullptr);
+        return nullptr;
+    }
+
+    auto generation_value = value.generation ? *value.generation : 0;
+
+    details::_push_referencing_usertype_block<T>(
+        l,
+        value.ptr,
+        sizeof(details::borrowed_block),
+        details::usertype_storage::borrowed,
+        [&](void* p) {
+            auto block = static_cast<const details::borrowed_block*>(p);
+            return block->generation == value.generation && block->generation_value == generation_value;
+        },
+        [&](void* p) {
+            auto block              = static_cast<details::borrowed_block*>(p);
+            block->ptr              = value.ptr;
+            block->generation       = value.generation;
+            block->generation_value = generation_value;
+        });
+
+    return value.ptr;
+}
+
+/* The userdata shares the ownership, __gc drops the reference */
+template <LuaRegisteredSharedPtrOrRef T>
+auto* luapush(lua_State* l, T&& value) {
+    using type = typename std::decay_t<T>::element_type;
+    auto ptr = value.get();
+    if (!ptr) {
+        luapush(l, nullptr);
+        return ptr;
+    }
+
+    details::_push_referencing_usertype_block<type>(
+        l,
+        ptr,
+        sizeof(details::shared_block<type>),
+        details::usertype_storage::shared,
+        [](void*) { return true; },
+        [&](void* p) {
+            new (&static_cast<details::shared_block<type>*>(p)->ptr) std::shared_ptr<type>(std::forward<T>(value));
+        });
+
+    return ptr;
+}
+
+/* The userdata retains the reference, __gc releases it */
+template <typename T>
+T* luapush(lua_State* l, const intrusive_ref<T>& value) {
+    if (!value.ptr) {
+        luapush(l, nullptr);
+        return nullptr;
+    }
+
+    details::_push_referencing_usertype_block<T>(
+        l,
+        value.ptr,
+        sizeof(details::intrusive_block),
+        details::usertype_storage::intrusive,
+        [](void*) { return true; },
+        [&](void* p) {
+            intrusive_ptr_add_ref(value.ptr);
+            static_cast<details::intrusive_block*>(p)->ptr = value.ptr;
+        });
+
+    return value.ptr;
+}
+
 inline void luapush(lua_State* l, lua_CFunction value) {
     lua_pushcfunction(l, value);
 }
@@ -314,27 +913,92 @@ bool luacheck(lua_State* l, int idx) {
     return lua_type(l, idx) == LUA_TBOOLEAN;
 }
 
+namespace details
+{
+    inline bool _number_is_integral(lua_Number value) {
+        auto fraction = value - std::trunc(value);
+        return std::isfinite(value) && !(fraction < 0 || fraction > 0);
+    }
+
+    /* The number at idx is an integer: the integer subtype in lua >= 5.3,
+     * the float without the fractional part in LuaJIT (it has no integer subtype)
+     */
+    inline bool _is_integer_number(lua_State* l, int idx) {
+#if LUA_VERSION_NUM >= 503
+        return lua_isinteger(l, idx);
+#else
+        return lua_type(l, idx) == LUA_TNUMBER && _number_is_integral(lua_tonumber(l, idx));
+#endif
+    }
+
+    /* The number at idx is in the range of the integer type T (the floats are checked before the truncation),
+     * any number fits the other types
+     */
+    template <typename T>
+    bool _number_fits(lua_State* l, int idx) {
+        using type = std::decay_t<T>;
+        if constexpr (LuaIntegerOrRef<T>) {
+#if LUA_VERSION_NUM >= 503
+            if (lua_isinteger(l, idx))
+                return std::in_range<type>(lua_tointeger(l, idx));
+#endif
+            auto number = lua_tonumber(l, idx);
+            return number > lua_Number(std::numeric_limits<type>::min()) - 1 &&
+                   number < lua_Number(std::numeric_limits<type>::max()) + 1;
+        }
+        else
+            return true;
+    }
+} // namespace details
+
 template <LuaNumberOrRef T>
 auto luaget(lua_State* l, int idx) {
+    using type = std::decay_t<T>;
+
     if (lua_type(l, idx) == LUA_TNUMBER) {
+        if constexpr (LuaIntegerOrRef<T>) {
 /* Handle integers in lua >= 5.3 */
 #if LUA_VERSION_NUM >= 503
-        if constexpr (LuaIntegerOrRef<T>)
-            return std::decay_t<T>(lua_tointeger(l, idx));
-        if constexpr (LuaFloatOrRef<T>)
+            int  isnum = 0;
+            auto value = lua_tointegerx(l, idx, &isnum);
+            if (isnum)
+                return type(value);
 #endif
-            return std::decay_t<T>(lua_tonumber(l, idx));
+            /* The floats are truncated, NaN, infinities and the values out of the T range give 0 */
+            auto number = lua_tonumber(l, idx);
+            if (number > lua_Number(std::numeric_limits<type>::min()) - 1 &&
+                number < lua_Number(std::numeric_limits<type>::max()) + 1)
+                return type(number);
+            return type(0);
+        }
+        else
+            return type(lua_tonumber(l, idx));
     }
     else
         throw errors::cast_error(l, idx, "this type can't be casted to C++ number", __PRETTY_FUNCTION__);
 }
 
-/* XXX: this check returns true on any numbers (float/integer)
- * This mean that the overloading by integer/float does not work
+/* Lua >= 5.3: the integer parameters accept the integers and the floats with the integral values
+ * representable as lua_Integer, so the overload f(int64_t) is skipped for 2.5 and f(double) is called.
+ * LuaJIT: any number is accepted by the integer parameters (there is no integer subtype),
+ * the overloads are told apart by the value in lua_overloaded_call_dispatch_entry only.
+ * In both cases the value must fit the range of T: f(int32_t) is skipped for 2^40
  */
 template <LuaNumberOrRef T>
 bool luacheck(lua_State* l, int idx) {
-    return lua_type(l, idx) == LUA_TNUMBER;
+    if (lua_type(l, idx) != LUA_TNUMBER)
+        return false;
+    if constexpr (LuaIntegerOrRef<T>) {
+#if LUA_VERSION_NUM >= 503
+        int  isnum = 0;
+        auto value = lua_tointegerx(l, idx, &isnum);
+        return isnum && std::in_range<std::decay_t<T>>(value);
+#else
+        return details::_number_fits<T>(l, idx);
+#endif
+    }
+    else
+        return true;
 }
 
 template <LuaOptionalLikeOrRef T>
@@ -350,6 +1014,9 @@ bool luacheck(lua_State* l, int idx) {
     return lua_type(l, idx) == LUA_TNIL || luacheck<std::decay_t<decltype(*T{})>>(l, idx);
 }
 
+/* std::string_view (and other types constructible from the pointer and the size) borrows the lua string,
+ * it stays valid while the string value is on the stack (for the function arguments - until the call returns)
+ */
 template <LuaStringLikeOrRef T>
 auto luaget(lua_State* l, int idx) {
     if (lua_type(l, idx) == LUA_TSTRING) {
@@ -366,12 +1033,31 @@ auto luaget(lua_State* l, int idx) {
 }
 
 
-template <typename T>
-    requires std::same_as<std::decay_t<T>, std::string>
+template <LuaStringLikeOrRef T>
 bool luacheck(lua_State* l, int idx) {
     return lua_type(l, idx) == LUA_TSTRING;
 }
 
+/* C-string argument: borrowed the same way as std::string_view, nil is converted to nullptr */
+template <typename T>
+    requires std::same_as<std::decay_t<T>, const char*>
+const char* luaget(lua_State* l, int idx) {
+    auto type = lua_type(l, idx);
+    if (type == LUA_TSTRING)
+        return lua_tostring(l, idx);
+    else if (type == LUA_TNIL)
+        return nullptr;
+    else
+        throw errors::cast_error(l, idx, "this type can't be casted to C++ const char*", __PRETTY_FUNCTION__);
+}
+
+template <typename T>
+    requires std::same_as<std::decay_t<T>, const char*>
+bool luacheck(lua_State* l, int idx) {
+    auto type = lua_type(l, idx);
+    return type == LUA_TSTRING || type == LUA_TNIL;
+}
+
 namespace details
 {
     template <typename T>
@@ -392,11 +1078,79 @@ namespace details
         return lua_type(l, -2) == LUA_TNUMBER && int(lua_tonumber(l, -2)) == index_check && luacheck<T>(l, -1);
     }
 
-    template <typename K, typename V>
-    auto _map_getnext(lua_State* l) {
-        auto k = luaget<K>(l, -2);
-        auto v = luaget<V>(l, -1);
-        return std::pair{k, v};
+    inline int _absindex(lua_State* l, int idx) {
+        return idx < 0 && idx > LUA_REGISTRYINDEX ? lua_gettop(l) + idx + 1 : idx;
+    }
+
+    /* The table at the absolute idx must have the keys 1..size only */
+    inline bool _array_has_extra_keys(lua_State* l, int idx, size_t size) {
+        size_t count = 0;
+        lua_pushnil(l);
+        while (lua_next(l, idx)) {
+            lua_pop(l, 1);
+            if (++count > size) {
+                lua_pop(l, 1);
+                return true;
+            }
+        }
+        return count != size;
+    }
+
+    /* Bulk path for LuaNumberArray: elements are read with lua_rawgeti straight into the presized storage
+     * Tuple-like containers (std::array) do not care about the keys beyond the size.
+     * Returns the error message on failure
+     */
+    template <typename T>
+    const char* _number_array_read(lua_State* l, int idx, T* data, size_t size, bool allow_extra_keys) {
+        if (!lua_checkstack(l, 2))
+            throw errors::stack_overflow();
+
+        idx = _absindex(l, idx);
+        for (size_t i = 0; i < size; ++i) {
+            lua_rawgeti(l, idx, int(i + 1));
+            if (!luacheck<T>(l, -1)) {
+                lua_pop(l, 1);
+                return "some element of lua table is not a number of the element type";
+            }
+            data[i] = luaget<T>(l, -1);
+            lua_pop(l, 1);
+        }
+
+        if (!allow_extra_keys && _array_has_extra_keys(l, idx, size))
+            return "some index key of lua table violates continuous order";
+
+        return nullptr;
+    }
+
+    template <typename T>
+    void _number_array_get(lua_State* l, int idx, T* data, size_t size, bool allow_extra_keys = false) {
+        if (auto error = _number_array_read(l, idx, data, size, allow_extra_keys))
+            throw errors::cast_error(l, idx, error, __PRETTY_FUNCTION__);
+    }
+
+    /* Elements are checked with the element luacheck, so the integer arrays reject the same values as the scalars */
+    template <typename T>
+    bool _number_array_check(lua_State* l, int idx, size_t size, bool allow_extra_keys = false) {
+        if (!lua_checkstack(l, 2))
+            return false;
+
+        idx = _absindex(l, idx);
+        for (size_t i = 0; i < size; ++i) {
+            lua_rawgeti(l, idx, int(i + 1));
+            bool is_number = luacheck<T>(l, -1);
+            lua_pop(l, 1);
+            if (!is_number)
+                return false;
+        }
+
+        return allow_extra_keys || !_array_has_extra_keys(l, idx, size);
+    }
+
+    template <typename K, typename V>
+    auto _map_getnext(lua_State* l) {
+        auto k = luaget<K>(l, -2);
+        auto v = luaget<V>(l, -1);
+        return std::pair{k, v};
     }
 
     template <typename K, typename V>
@@ -412,6 +1166,12 @@ auto luaget(lua_State* l, int idx) {
     std::decay_t<T> result;
     using value_t = std::decay_t<decltype(*result.begin())>;
 
+    if constexpr (LuaNumberArray<std::decay_t<T>> && requires { result.resize(size_t(0)); }) {
+        result.resize(lua_objlen(l, idx));
+        details::_number_array_get(l, idx, std::ranges::data(result), std::ranges::size(result));
+        return result;
+    }
+
     /* For using relative stack pos */
     lua_pushvalue(l, idx);
     lua_pushnil(l);
@@ -443,6 +1203,9 @@ bool luacheck(lua_State* l, int idx) {
             return false;
     }
 
+    if constexpr (LuaNumberArray<std::decay_t<T>>)
+        return details::_number_array_check<std::ranges::range_value_t<std::decay_t<T>>>(l, idx, lua_objlen(l, idx));
+
     using value_t = std::decay_t<decltype(*std::declval<T>().begin())>;
 
     lua_pushvalue(l, idx);
@@ -471,6 +1234,11 @@ auto luaget(lua_State* l, int idx) {
 
     using value_t = std::decay_t<decltype(result[0])>;
 
+    if constexpr (LuaNumberArray<std::decay_t<T>>) {
+        details::_number_array_get(l, idx, std::ranges::data(result), std::ranges::size(result));
+        return result;
+    }
+
     /* For using relative stack pos */
     lua_pushvalue(l, idx);
     lua_pushnil(l);
@@ -557,29 +1325,35 @@ auto luaget(lua_State* l, int idx) {
     if (lua_objlen(l, idx) != std::tuple_size_v<type>)
         throw errors::cast_error(l, idx, "lua table and tuple lengths do not match", __PRETTY_FUNCTION__);
 
-    /* For using relative stack pos */
-    lua_pushvalue(l, idx);
-    lua_pushnil(l);
+    if constexpr (LuaNumberArray<type>) {
+        details::_number_array_get(l, idx, std::ranges::data(result), std::ranges::size(result), true);
+        return result;
+    }
+    else {
+        /* For using relative stack pos */
+        lua_pushvalue(l, idx);
+        lua_pushnil(l);
 
-    auto guard = exception_guard{[l] {
-        lua_pop(l, 3);
-    }};
+        auto guard = exception_guard{[l] {
+            lua_pop(l, 3);
+        }};
 
-    static constexpr auto getall =
-        []<size_t... Idxs>(type & v, [[maybe_unused]] lua_State * l, std::index_sequence<Idxs...>) {
-        [[maybe_unused]] static constexpr auto op =
-            []<size_t idx>(type& v, lua_State* l, luacppdetails::nttp_tag<idx>) {
-                lua_next(l, -2);
-                std::get<idx>(v) = details::_array_getnext<std::tuple_element_t<idx, type>>(l, int(idx + 1));
-                lua_pop(l, 1);
-            };
-        ((op(v, l, luacppdetails::nttp_tag<Idxs>{})), ...);
-    };
+        static constexpr auto getall =
+            []<size_t... Idxs>(type & v, [[maybe_unused]] lua_State * l, std::index_sequence<Idxs...>) {
+            [[maybe_unused]] static constexpr auto op =
+                []<size_t idx>(type& v, lua_State* l, luacppdetails::nttp_tag<idx>) {
+                    lua_next(l, -2);
+                    std::get<idx>(v) = details::_array_getnext<std::tuple_element_t<idx, type>>(l, int(idx + 1));
+                    lua_pop(l, 1);
+                };
+            ((op(v, l, luacppdetails::nttp_tag<Idxs>{})), ...);
+        };
 
-    getall(result, l, std::make_index_sequence<std::tuple_size_v<type>>());
-    lua_pop(l, 2);
+        getall(result, l, std::make_index_sequence<std::tuple_size_v<type>>());
+        lua_pop(l, 2);
 
-    return result;
+        return result;
+    }
 }
 
 template <LuaTupleLikeOrRef T>
@@ -592,42 +1366,86 @@ bool luacheck(lua_State* l, int idx) {
     if (lua_objlen(l, idx) != std::tuple_size_v<type>)
         return false;
 
-    lua_pushvalue(l, idx);
-    lua_pushnil(l);
-
-    auto guard = exception_guard{[l] {
-        lua_pop(l, 3);
-    }};
+    if constexpr (LuaNumberArray<type>) {
+        return details::_number_array_check<std::ranges::range_value_t<type>>(l, idx, std::tuple_size_v<type>, true);
+    }
+    else {
+        lua_pushvalue(l, idx);
+        lua_pushnil(l);
 
-    bool result = true;
+        auto guard = exception_guard{[l] {
+            lua_pop(l, 3);
+        }};
 
-    static constexpr auto checkall =
-        []<size_t... Idxs>([[maybe_unused]] lua_State * l, bool& result, std::index_sequence<Idxs...>) {
-        [[maybe_unused]] static constexpr auto op =
-            []<size_t idx>(lua_State* l, bool& result, luacppdetails::nttp_tag<idx>) {
-                lua_next(l, -2);
-                if (result)
-                    if (!details::_array_check<std::tuple_element_t<idx, type>>(l, int(idx + 1)))
-                        result = false;
-                lua_pop(l, 1);
-            };
-        ((op(l, result, luacppdetails::nttp_tag<Idxs>{})), ...);
-    };
+        bool result = true;
+
+        static constexpr auto checkall =
+            []<size_t... Idxs>([[maybe_unused]] lua_State * l, bool& result, std::index_sequence<Idxs...>) {
+            [[maybe_unused]] static constexpr auto op =
+                []<size_t idx>(lua_State* l, bool& result, luacppdetails::nttp_tag<idx>) {
+                    lua_next(l, -2);
+                    if (result)
+                        if (!details::_array_check<std::tuple_element_t<idx, type>>(l, int(idx + 1)))
+                            result = false;
+                    lua_pop(l, 1);
+                };
+            ((op(l, result, luacppdetails::nttp_tag<Idxs>{})), ...);
+        };
 
-    checkall(l, result, std::make_index_sequence<std::tuple_size_v<type>>());
-    lua_pop(l, 2);
+        checkall(l, result, std::make_index_sequence<std::tuple_size_v<type>>());
+        lua_pop(l, 2);
 
-    return result;
+        return result;
+    }
 }
 
+namespace details
+{
+    /* The cdata check goes through ffi.istype, the ctype id can't be read with the lua API */
+    template <typename T>
+    bool _is_ffi_struct(lua_State* l, int idx) {
+        idx = _absindex(l, idx);
+        luaregistry_get(l, &ffi_struct_istype_key<T>);
+        if (lua_isnil(l, -1)) {
+            lua_pop(l, 1);
+            return false;
+        }
+        lua_pushvalue(l, idx);
+        lua_call(l, 1, 1);
+        bool result = lua_toboolean(l, -1);
+        lua_pop(l, 1);
+        return result;
+    }
+} // namespace details
+
 /* This is the only thing that can return references */
 template <LuaRegisteredTypeRefOrPtr T>
 T luaget(lua_State* l, int idx) {
+    using type      = std::decay_t<std::remove_pointer_t<T>>;
+    using pointer_t = std::conditional_t<std::is_pointer_v<T>, T, std::decay_t<T>*>;
+
+    if constexpr (details::ffi_struct_enabled<type>()) {
+        if (lua_type(l, idx) == details::lua_tcdata) {
+            if (!details::_is_ffi_struct<type>(l, idx))
+                throw errors::cast_error(
+                    l, idx, "cdata is not a " + std::string(type_registry::get_typespec<type>().lua_name().data()),
+                    __PRETTY_FUNCTION__);
+
+            auto data = static_cast<pointer_t>(const_cast<void*>(lua_topointer(l, idx))); // NOLINT
+            if constexpr (std::is_pointer_v<T>)
+                return data;
+            else
+                return *data;
+        }
+    }
+
     if (lua_type(l, idx) != LUA_TUSERDATA)
         throw errors::cast_error(l, idx, "this type can't be casted to C++ userdata type", __PRETTY_FUNCTION__);
 
-    size_t           objlen  = lua_objlen(l, idx);
-    constexpr size_t reallen = sizeof(uint64_t) + sizeof(std::remove_pointer_t<T>);
+    auto   header  = details::_usertype_header(l, idx);
+    auto   storage = details::_usertype_storage(header);
+    size_t objlen  = lua_objlen(l, idx);
+    size_t reallen = details::_usertype_block_size<type>(storage);
     if (objlen != reallen)
         throw errors::cast_error(l,
                                  idx,
@@ -635,22 +1453,21 @@ T luaget(lua_State* l, int idx) {
                                      std::to_string(reallen) + ") ",
                                  __PRETTY_FUNCTION__);
 
-    /* TODO: check address alignment for this */
-    void*    ptr = lua_touserdata(l, idx);
-    uint64_t type_index;
-    std::memcpy(&type_index, ptr, sizeof(type_index));
-
-    using pointer_t = std::conditional_t<std::is_pointer_v<T>, T, std::decay_t<T>*>;
-
-    if (type_registry::get_index<std::remove_pointer_t<pointer_t>>() != type_index)
+    if (type_registry::get_index<type>() != (header & ~details::usertype_storage_mask))
         throw errors::cast_error(
-            l,
-            idx,
-            "userdata is not a " +
-                std::string(type_registry::get_typespec<std::remove_pointer_t<pointer_t>>().lua_name().data()),
+            l, idx, "userdata is not a " + std::string(type_registry::get_typespec<type>().lua_name().data()),
             __PRETTY_FUNCTION__);
 
-    auto data = reinterpret_cast<pointer_t>(reinterpret_cast<char*>(ptr) + sizeof(uint64_t)); // NOLINT
+    void* ptr = lua_touserdata(l, idx);
+    if (storage == details::usertype_storage::borrowed &&
+        details::_borrowed_is_expired(static_cast<const details::borrowed_block*>(ptr)))
+        throw errors::cast_error(l,
+                                 idx,
+                                 "borrowed " + std::string(type_registry::get_typespec<type>().lua_name().data()) +
+                                     " is expired",
+                                 __PRETTY_FUNCTION__);
+
+    pointer_t data = details::_usertype_object<type>(ptr, storage);
 
     if constexpr (std::is_pointer_v<T>)
         return data;
@@ -660,16 +1477,300 @@ T luaget(lua_State* l, int idx) {
 
 template <LuaRegisteredTypeRefOrPtr T>
 bool luacheck(lua_State* l, int idx) {
-    if (lua_type(l, idx) != LUA_TUSERDATA || lua_objlen(l, idx) != sizeof(uint64_t) + sizeof(std::remove_pointer_t<T>))
+    using type = std::decay_t<std::remove_pointer_t<T>>;
+
+    if constexpr (details::ffi_struct_enabled<type>()) {
+        if (lua_type(l, idx) == details::lua_tcdata)
+            return details::_is_ffi_struct<type>(l, idx);
+    }
+
+    if (lua_type(l, idx) != LUA_TUSERDATA)
         return false;
 
-    void*    ptr = lua_touserdata(l, idx);
-    uint64_t type_index;
-    std::memcpy(&type_index, ptr, sizeof(type_index));
+    auto header  = details::_usertype_header(l, idx);
+    auto storage = details::_usertype_storage(header);
+    if (lua_objlen(l, idx) != details::_usertype_block_size<type>(storage) ||
+        type_registry::get_index<type>() != (header & ~details::usertype_storage_mask))
+        return false;
+
+    return storage != details::usertype_storage::borrowed ||
+           !details::_borrowed_is_expired(static_cast<const details::borrowed_block*>(lua_touserdata(l, idx)));
+}
+
+/* Copy of the owning std::shared_ptr, the userdata must be pushed by std::shared_ptr */
+template <LuaRegisteredSharedPtrOrRef T>
+std::decay_t<T> luaget(lua_State* l, int idx) {
+    using type = typename std::decay_t<T>::element_type;
+
+    if (lua_type(l, idx) == LUA_TNIL)
+        return {};
+
+    luaget<type*>(l, idx);
+    if (lua_type(l, idx) != LUA_TUSERDATA ||
+        details::_usertype_storage(details::_usertype_header(l, idx)) != details::usertype_storage::shared)
+        throw errors::cast_error(l,
+                                 idx,
+                                 std::string(type_registry::get_typespec<type>().lua_name().data()) +
+                                     " is not owned by std::shared_ptr",
+                                 __PRETTY_FUNCTION__);
+
+    return static_cast<details::shared_block<type>*>(lua_touserdata(l, idx))->ptr;
+}
+
+template <LuaRegisteredSharedPtrOrRef T>
+bool luacheck(lua_State* l, int idx) {
+    using type = typename std::decay_t<T>::element_type;
+    return lua_type(l, idx) == LUA_TNIL ||
+           (luacheck<type*>(l, idx) && lua_type(l, idx) == LUA_TUSERDATA &&
+            details::_usertype_storage(details::_usertype_header(l, idx)) == details::usertype_storage::shared);
+}
+
+namespace details
+{
+    /* Releases the object of the userdata at idx, the userdata must be checked before
+     * The values of T without the finalizer are left as is: __gc is installed for their owning references only
+     */
+    template <typename T>
+    void _usertype_destroy(lua_State* l, int idx) {
+        auto storage = _usertype_storage(_usertype_header(l, idx));
+        auto block   = lua_touserdata(l, idx);
+
+        switch (storage) {
+        case usertype_storage::borrowed: break;
+        case usertype_storage::shared: static_cast<shared_block<T>*>(block)->ptr.~shared_ptr(); break;
+        case usertype_storage::intrusive:
+            if constexpr (LuaIntrusiveRefcounted<T>)
+                intrusive_ptr_release(static_cast<T*>(static_cast<intrusive_block*>(block)->ptr));
+            break;
+        default:
+            if constexpr (type_registry::get_typespec<T>().has_gc())
+                _usertype_object<T>(block, storage)->~T();
+            break;
+        }
+    }
+
+    /* __gc of the registered types
+     * Works on the state which runs the finalizer (it may be a coroutine) and never throws:
+     * the userdata of other types and layouts is ignored
+     */
+    template <typename T>
+    int _usertype_gc(lua_State* l) {
+        if (lua_type(l, 1) != LUA_TUSERDATA)
+            return 0;
+
+        auto header = _usertype_header(l, 1);
+        if (lua_objlen(l, 1) != _usertype_block_size<T>(_usertype_storage(header)) ||
+            type_registry::get_index<T>() != (header & ~usertype_storage_mask))
+            return 0;
+
+        _usertype_destroy<T>(l, 1);
+        return 0;
+    }
+} // namespace details
+
+/* Check and convert in one pass
+ * Returns an empty optional if the value can't be converted to T, containers are walked only once.
+ * References to the registered types are returned as std::reference_wrapper
+ */
+template <typename T>
+using luaget_result_t = decltype(luaget<T>(std::declval<lua_State*>(), 0));
+
+template <typename T>
+using luaget_optional =
+    std::optional<std::conditional_t<std::is_reference_v<luaget_result_t<T>>,
+                                     std::reference_wrapper<std::remove_reference_t<luaget_result_t<T>>>,
+                                     luaget_result_t<T>>>;
+
+template <typename T>
+luaget_optional<T> try_luaget(lua_State* l, int idx) {
+    using type = std::decay_t<T>;
+
+    if constexpr (LuaOptionalLike<type>) {
+        if (lua_type(l, idx) == LUA_TNIL)
+            return type{};
+        auto value = try_luaget<std::decay_t<decltype(*type{})>>(l, idx);
+        if (!value)
+            return {};
+        return type{std::move(*value)};
+    }
+    else if constexpr (LuaNumberArray<type> && (LuaTupleLike<type> || requires(type& v) { v.resize(size_t(0)); })) {
+        if (lua_type(l, idx) != LUA_TTABLE)
+            return {};
+
+        type result;
+        auto size = lua_objlen(l, idx);
+        if constexpr (LuaTupleLike<type>) {
+            if (size != std::tuple_size_v<type>)
+                return {};
+        }
+        else {
+            result.resize(size);
+        }
+
+        if (details::_number_array_read(l, idx, std::ranges::data(result), std::ranges::size(result), LuaTupleLike<type>))
+            return {};
+        return result;
+    }
+    else if constexpr (LuaPushBackable<type> || LuaStaticSettable<type>) {
+        if (lua_type(l, idx) != LUA_TTABLE)
+            return {};
+
+        type result;
+        if constexpr (LuaStaticSettable<type>) {
+            if (lua_objlen(l, idx) != size(result))
+                return {};
+        }
+        using value_t = std::decay_t<decltype(*result.begin())>;
+
+        lua_pushvalue(l, idx);
+        lua_pushnil(l);
+
+        auto guard = exception_guard{[l] {
+            lua_pop(l, 3);
+        }};
+
+        int index_check = 1;
+        while (lua_next(l, -2)) {
+            if (lua_type(l, -2) != LUA_TNUMBER || int(lua_tonumber(l, -2)) != index_check) {
+                lua_pop(l, 3);
+                return {};
+            }
+
+            auto value = try_luaget<value_t>(l, -1);
+            if (!value) {
+                lua_pop(l, 3);
+                return {};
+            }
+
+            if constexpr (LuaStaticSettable<type>)
+                result[size_t(index_check - 1)] = std::move(*value);
+            else
+                result.push_back(std::move(*value));
+
+            ++index_check;
+            lua_pop(l, 1);
+        }
+
+        lua_pop(l, 1);
+        return result;
+    }
+    else if constexpr (LuaMapLike<type>) {
+        if (lua_type(l, idx) != LUA_TTABLE)
+            return {};
+
+        type result;
+        using key_t   = std::decay_t<decltype(std::get<0>(*result.begin()))>;
+        using value_t = std::decay_t<decltype(std::get<1>(*result.begin()))>;
+
+        lua_pushvalue(l, idx);
+        lua_pushnil(l);
+
+        auto guard = exception_guard{[l] {
+            lua_pop(l, 3);
+        }};
+
+        while (lua_next(l, -2)) {
+            auto key   = try_luaget<key_t>(l, -2);
+            auto value = key ? try_luaget<value_t>(l, -1) : std::nullopt;
+            if (!value) {
+                lua_pop(l, 3);
+                return {};
+            }
+            result.emplace(std::move(*key), std::move(*value));
+            lua_pop(l, 1);
+        }
+
+        lua_pop(l, 1);
+        return result;
+    }
+    else if constexpr (LuaTupleLike<type>) {
+        if (lua_type(l, idx) != LUA_TTABLE || lua_objlen(l, idx) != std::tuple_size_v<type>)
+            return {};
+        if (!lua_checkstack(l, 1))
+            return {};
+
+        idx = details::_absindex(l, idx);
+        type result;
+        bool converted = [&]<size_t... Idxs>(std::index_sequence<Idxs...>) {
+            return ([&] {
+                lua_rawgeti(l, idx, int(Idxs + 1));
+                auto guard = finalizer{[l] {
+                    lua_pop(l, 1);
+                }};
+                auto value = try_luaget<std::tuple_element_t<Idxs, type>>(l, -1);
+                if (value)
+                    std::get<Idxs>(result) = std::move(*value);
+                return value.has_value();
+            }() && ...);
+        }(std::make_index_sequence<std::tuple_size_v<type>>());
+
+        if (!converted)
+            return {};
+        return result;
+    }
+    else {
+        if constexpr (requires { luacheck<T>(l, idx); }) {
+            if (!luacheck<T>(l, idx))
+                return {};
+        }
+        return luaget_optional<T>{std::in_place, luaget<T>(l, idx)};
+    }
+}
+
+namespace details
+{
+    template <typename T>
+    typed_array_header* _typed_array_header(lua_State* l, int idx) {
+        if (lua_type(l, idx) != LUA_TUSERDATA || lua_objlen(l, idx) < sizeof(typed_array_header))
+            return nullptr;
+
+        auto header = static_cast<typed_array_header*>(lua_touserdata(l, idx));
+        if (header->tag != typed_array_traits<T>::tag ||
+            lua_objlen(l, idx) != sizeof(typed_array_header) + header->size * sizeof(T))
+            return nullptr;
+
+        return header;
+    }
+} // namespace details
+
+/* Zero-copy view of the typed_array elements, valid while the userdata is alive */
+template <LuaTypedArraySpanOrRef T>
+std::decay_t<T> luaget(lua_State* l, int idx) {
+    using span_t    = std::decay_t<T>;
+    using element_t = std::remove_const_t<typename span_t::element_type>;
+
+    auto header = details::_typed_array_header<element_t>(l, idx);
+    if (!header)
+        throw errors::cast_error(l,
+                                 idx,
+                                 std::string("value is not a typed_array of ") + typed_array_traits<element_t>::name,
+                                 __PRETTY_FUNCTION__);
+
+    auto data = reinterpret_cast<element_t*>(header + 1); // NOLINT
+    return span_t(data, size_t(header->size));
+}
 
-    return type_registry::get_index<std::decay_t<std::remove_pointer_t<T>>>() == type_index;
+template <LuaTypedArraySpanOrRef T>
+bool luacheck(lua_State* l, int idx) {
+    using element_t = std::remove_const_t<typename std::decay_t<T>::element_type>;
+    return details::_typed_array_header<element_t>(l, idx) != nullptr;
 }
 
+namespace details
+{
+    /* Pushes the error message with the position like luaL_error does, without the format string */
+    inline void _push_error_message(lua_State* l, std::string_view message) {
+        luaL_where(l, 1);
+        lua_pushlstring(l, message.data(), message.size());
+        lua_concat(l, 2);
+    }
+
+    /* Returned by the calls instead of the values count, when the error of result<T> is on the top of the stack.
+     * The call wrappers raise it after the return, so the C++ locals of the call are already destroyed
+     */
+    inline constexpr int lua_result_error = -2;
+} // namespace details
+
 template <typename F, typename RF, uint64_t UniqId>
 struct func_storage {
     static func_storage& instance() {
@@ -677,13 +1778,15 @@ struct func_storage {
         return inst;
     }
 
+    /* The lua error is raised out of the handler, so the exception object is destroyed before the longjmp */
     int call(lua_State* state) const {
         try {
-            return f(state, *rf);
+            if (int rc = f(state, *rf); rc != details::lua_result_error)
+                return rc;
         } catch (const std::exception& e) {
-            luaL_error(state, e.what());
-            return 0;
+            details::_push_error_message(state, e.what());
         }
+        return lua_error(state);
     }
 
     F                 f;
@@ -699,11 +1802,12 @@ struct overloaded_func_storage {
 
     int call(lua_State* state) const {
         try {
-            return std::apply(f, std::tuple_cat(std::tuple{state}, *rfs));
+            if (int rc = std::apply(f, std::tuple_cat(std::tuple{state}, *rfs)); rc != details::lua_result_error)
+                return rc;
         } catch (const std::exception& e) {
-            luaL_error(state, e.what());
-            return 0;
+            details::_push_error_message(state, e.what());
         }
+        return lua_error(state);
     }
 
     F                                 f;
@@ -737,11 +1841,221 @@ struct explicit_return {
         (ctx.push(std::forward<Ts>(values)), ...);
     }
 
-    int values_count = 0;
-};
-
-namespace details
-{
+    int values_count = 0;
+};
+
+/* Multiple values returned from lua function, or returned to lua from C++ function as the native multiple returns */
+template <typename... ArgsT>
+struct multiresult {
+    static constexpr size_t count = sizeof...(ArgsT);
+
+    multiresult(lua_State* l):
+        storage([]<size_t... Idxs>(lua_State * l, std::index_sequence<Idxs...>) {
+            static constexpr auto sz = sizeof...(ArgsT);
+            return std::tuple<ArgsT...>(luaget<ArgsT>(l, -int(sz - Idxs))...);
+        }(l, std::make_index_sequence<sizeof...(ArgsT)>())) {}
+
+    template <typename... Ts>
+        requires(sizeof...(Ts) == sizeof...(ArgsT) && (std::constructible_from<ArgsT, Ts&&> && ...))
+    multiresult(Ts&&... values): storage(std::forward<Ts>(values)...) {}
+
+    template <size_t N>
+    constexpr decltype(auto) get() {
+        return std::get<N>(storage);
+    }
+    template <size_t N>
+    constexpr decltype(auto) get() const {
+        return std::get<N>(storage);
+    }
+
+    constexpr size_t size() const {
+        return sizeof...(ArgsT);
+    }
+
+    std::tuple<ArgsT...> storage;
+};
+
+template <typename... Ts>
+multiresult(Ts...) -> multiresult<Ts...>;
+
+namespace details
+{
+    template <typename T>
+    struct is_multiresult : std::false_type {};
+    template <typename... Ts>
+    struct is_multiresult<multiresult<Ts...>> : std::true_type {};
+} // namespace details
+
+template <typename T>
+concept LuaMultiresult = details::is_multiresult<T>::value;
+
+/* Error of the result<T>, the message is raised as the lua error */
+struct result_error {
+    std::string message;
+};
+
+/* Return type of the exception-free bindings: the value or the error.
+ * The interface is a subset of std::expected<T, std::string>, which is accepted as well.
+ * Functions and member functions must be noexcept (see result_function_closure),
+ * overloaded sets keep the try/catch of the dispatcher, the errors of the results are raised the same way
+ */
+template <typename T = void>
+class result {
+public:
+    using value_type = T;
+    using error_type = std::string;
+
+    result(T value): storage(std::in_place_index<0>, std::move(value)) {}
+    result(result_error error): storage(std::in_place_index<1>, std::move(error.message)) {}
+
+    [[nodiscard]] bool has_value() const {
+        return storage.index() == 0;
+    }
+
+    explicit operator bool() const {
+        return has_value();
+    }
+
+    T& operator*() {
+        return *std::get_if<0>(&storage);
+    }
+
+    const T& operator*() const {
+        return *std::get_if<0>(&storage);
+    }
+
+    [[nodiscard]] const std::string& error() const {
+        return *std::get_if<1>(&storage);
+    }
+
+private:
+    std::variant<T, std::string> storage;
+};
+
+template <>
+class result<void> {
+public:
+    using value_type = void;
+    using error_type = std::string;
+
+    result() = default;
+    result(result_error error): storage(std::move(error.message)) {}
+
+    [[nodiscard]] bool has_value() const {
+        return !storage;
+    }
+
+    explicit operator bool() const {
+        return has_value();
+    }
+
+    [[nodiscard]] const std::string& error() const {
+        return *storage;
+    }
+
+private:
+    std::optional<std::string> storage;
+};
+
+/* result<T>, std::expected<T, E> and alike */
+template <typename T>
+concept LuaResultLike = requires(const T& v) {
+    typename T::value_type;
+    typename T::error_type;
+    { v.has_value() } -> std::convertible_to<bool>;
+    v.error();
+};
+
+namespace details
+{
+    /* The types which luacheck depends on the lua_type of the value only */
+    template <typename T>
+    constexpr bool lua_shallow_checkable() {
+        using type = std::decay_t<T>;
+        if constexpr (std::same_as<type, placeholder> || std::same_as<type, bool> || LuaNumber<type> ||
+                      LuaStringLike<type> || std::same_as<type, const char*>)
+            return true;
+        else if constexpr (LuaOptionalLike<type>)
+            return lua_shallow_checkable<decltype(*type{})>();
+        else
+            return false;
+    }
+
+    /* Cheap check by the lua_type: false means that luacheck<T> certainly fails */
+    template <typename T>
+    bool lua_type_may_match(lua_State* l, int idx) {
+        using type = std::decay_t<T>;
+        if constexpr (lua_shallow_checkable<T>())
+            return luacheck<T>(l, idx);
+        else if constexpr (LuaOptionalLike<type>)
+            return lua_type(l, idx) == LUA_TNIL || lua_type_may_match<decltype(*type{})>(l, idx);
+        else if constexpr (LuaRegisteredTypeRefOrPtr<T> || LuaTypedArraySpanOrRef<T>) {
+            if constexpr (LuaRegisteredTypeRefOrPtr<T> && ffi_struct_enabled<std::decay_t<std::remove_pointer_t<T>>>())
+                return lua_type(l, idx) == LUA_TUSERDATA || lua_type(l, idx) == lua_tcdata;
+            else
+                return lua_type(l, idx) == LUA_TUSERDATA;
+        }
+        else if constexpr (LuaPushBackable<type> || LuaStaticSettable<type> || LuaTupleLike<type> ||
+                           LuaMapLike<type>)
+            return lua_type(l, idx) == LUA_TTABLE;
+        else
+            return true;
+    }
+
+    /* Pushes the error of the result: strings and exceptions as the messages, other errors as they are */
+    template <typename E>
+    void _push_result_error(lua_State* l, const E& error) {
+        if constexpr (std::convertible_to<const E&, std::string_view>)
+            _push_error_message(l, error);
+        else if constexpr (requires { error.what(); })
+            _push_error_message(l, error.what());
+        else if constexpr (requires { error.message(); })
+            _push_error_message(l, error.message());
+        else
+            luapush(l, error);
+    }
+
+    /* Calls the function and pushes the result, returns the count of the pushed values
+     * or lua_result_error with the error on the top of the stack
+     */
+    template <typename ReturnT>
+    int _call_and_push(lua_State* l, auto&& function, auto&&... args) {
+        if constexpr (std::is_same_v<ReturnT, void>) {
+            function(std::forward<decltype(args)>(args)...);
+            return 0;
+        }
+        else if constexpr (std::is_same_v<ReturnT, explicit_return>) {
+            return function(std::forward<decltype(args)>(args)...).values_count;
+        }
+        else if constexpr (LuaResultLike<std::decay_t<ReturnT>>) {
+            auto result = function(std::forward<decltype(args)>(args)...);
+            if (!result.has_value()) {
+                _push_result_error(l, result.error());
+                return lua_result_error;
+            }
+
+            using value_t = typename std::decay_t<ReturnT>::value_type;
+            if constexpr (std::is_void_v<value_t>)
+                return 0;
+            else
+                return _call_and_push<value_t>(l, [&]() -> value_t&& { return std::move(*result); });
+        }
+        else if constexpr (LuaMultiresult<std::decay_t<ReturnT>>) {
+            constexpr auto count = int(std::decay_t<ReturnT>::count);
+            if constexpr (count >= LUA_MINSTACK)
+                if (!lua_checkstack(l, count))
+                    throw errors::stack_overflow();
+
+            std::apply([l](auto&&... values) { (luapush(l, std::forward<decltype(values)>(values)), ...); },
+                       function(std::forward<decltype(args)>(args)...).storage);
+            return count;
+        }
+        else {
+            luapush(l, function(std::forward<decltype(args)>(args)...));
+            return 1;
+        }
+    }
+
     template <typename ReturnT, typename... ArgsT>
     int _function_call(lua_State* l, auto&& function) {
         auto lua_args_count = lua_gettop(l);
@@ -751,26 +2065,115 @@ namespace details
                                          ", but C++ function defined with " + std::to_string(sizeof...(ArgsT)) +
                                          " arguments)");
 
-        if constexpr (std::is_same_v<ReturnT, void>) {
-            []<size_t... Idxs>([[maybe_unused]] lua_State * l, auto&& function, std::index_sequence<Idxs...>) {
-                return function(luaget<ArgsT>(l, int(Idxs + 1))...);
-            }
-            (l, function, std::make_index_sequence<sizeof...(ArgsT)>());
-            return 0;
+        return []<size_t... Idxs>([[maybe_unused]] lua_State * l, auto&& function, std::index_sequence<Idxs...>) {
+            return _call_and_push<ReturnT>(l, function, luaget<ArgsT>(l, int(Idxs + 1))...);
+        }(l, function, std::make_index_sequence<sizeof...(ArgsT)>());
+    }
+
+    /* Conversion without the type checks for the unchecked bindings (see luaprovide_unchecked)
+     * The value must have the expected type, the types without the raw conversion go through luaget
+     */
+    template <typename T>
+    decltype(auto) _luaget_unchecked(lua_State* l, int idx) {
+        using type = std::decay_t<T>;
+
+        if constexpr (std::same_as<type, bool>)
+            return lua_toboolean(l, idx) != 0;
+#if LUA_VERSION_NUM >= 503
+        else if constexpr (LuaInteger<type>)
+            return type(lua_tointeger(l, idx));
+#endif
+        else if constexpr (LuaNumber<type>)
+            return type(lua_tonumber(l, idx));
+        else if constexpr (std::same_as<type, std::string_view>) {
+            size_t len;
+            auto   str = lua_tolstring(l, idx, &len);
+            return std::string_view(str, len);
         }
-        else if constexpr (std::is_same_v<ReturnT, explicit_return>) {
-            return []<size_t... Idxs>([[maybe_unused]] lua_State * l, auto&& function, std::index_sequence<Idxs...>) {
-                return function(luaget<ArgsT>(l, int(Idxs + 1))...);
-            }
-            (l, function, std::make_index_sequence<sizeof...(ArgsT)>()).values_count;
+        else if constexpr (std::same_as<type, const char*>)
+            return lua_tostring(l, idx);
+        else if constexpr (LuaRegisteredTypeRefOrPtr<T> && !ffi_struct_enabled<std::remove_pointer_t<type>>()) {
+            using object_t = std::remove_pointer_t<type>;
+            auto block     = lua_touserdata(l, idx);
+            auto data      = _usertype_object<object_t>(block, _usertype_storage(_usertype_header(l, idx)));
+            if constexpr (std::is_pointer_v<type>)
+                return data;
+            else
+                return *data;
         }
-        else {
-            luapush(
-                l, []<size_t... Idxs>([[maybe_unused]] lua_State * l, auto&& function, std::index_sequence<Idxs...>) {
-                    return function(luaget<ArgsT>(l, int(Idxs + 1))...);
-                }(l, function, std::make_index_sequence<sizeof...(ArgsT)>()));
-            return 1;
+        else
+            return luaget<T>(l, idx);
+    }
+
+    template <typename ReturnT, typename... ArgsT>
+    int _unchecked_function_call(lua_State* l, auto&& function) {
+        return [&]<size_t... Idxs>(std::index_sequence<Idxs...>) {
+            return _call_and_push<ReturnT>(l, function, _luaget_unchecked<ArgsT>(l, int(Idxs + 1))...);
+        }(std::make_index_sequence<sizeof...(ArgsT)>());
+    }
+
+    template <typename T>
+    struct _is_reference_wrapper : std::false_type {};
+
+    template <typename T>
+    struct _is_reference_wrapper<std::reference_wrapper<T>> : std::true_type {};
+
+    template <typename T>
+    decltype(auto) _unwrap_luaget_optional(std::optional<T>& value) {
+        if constexpr (_is_reference_wrapper<T>::value)
+            return value->get();
+        else
+            return std::move(*value);
+    }
+
+    /* Overload candidate call: returns -1 without calling if some argument can't be converted.
+     * The cheap arguments (numbers, strings, booleans) are checked before any container is converted
+     */
+    template <typename ReturnT, typename... ArgsT>
+    int _try_function_call(lua_State* l, auto&& function) {
+        return [&]<size_t... Idxs>(std::index_sequence<Idxs...>) {
+            if (!((!lua_shallow_checkable<ArgsT>() || luacheck<ArgsT>(l, int(Idxs + 1))) && ... && true))
+                return -1;
+
+            std::tuple<luaget_optional<ArgsT>...> args;
+            if (!((std::get<Idxs>(args) = try_luaget<ArgsT>(l, int(Idxs + 1))) && ... && true))
+                return -1;
+
+            return _call_and_push<ReturnT>(l, function, _unwrap_luaget_optional(std::get<Idxs>(args))...);
+        }(std::make_index_sequence<sizeof...(ArgsT)>());
+    }
+
+    /* Call of the function returning result<T> or std::expected<T, E> without any try/catch.
+     * Returns lua_result_error with the error on the top of the stack if the arguments don't match
+     * or the function failed, the caller raises it after the return
+     */
+    template <typename ReturnT, typename... ArgsT>
+    int _result_function_call(lua_State* l, auto&& function) {
+        auto lua_args_count = lua_gettop(l);
+
+        if (size_t(lua_args_count) != sizeof...(ArgsT)) {
+            luaL_where(l, 1);
+            lua_pushfstring(l,
+                            "arguments count mismatch (lua called with %d, but C++ function defined with %d arguments)",
+                            lua_args_count,
+                            int(sizeof...(ArgsT)));
+            lua_concat(l, 2);
+            return lua_result_error;
         }
+
+        return [&]<size_t... Idxs>(std::index_sequence<Idxs...>) {
+            std::tuple<luaget_optional<ArgsT>...> args;
+            int                                   bad_arg = 0;
+            if (!(((std::get<Idxs>(args) = try_luaget<ArgsT>(l, int(Idxs + 1))) || (bad_arg = int(Idxs + 1), false)) &&
+                  ... && true)) {
+                luaL_where(l, 1);
+                lua_pushfstring(l, "bad argument #%d (got %s)", bad_arg, luaL_typename(l, bad_arg));
+                lua_concat(l, 2);
+                return lua_result_error;
+            }
+
+            return _call_and_push<ReturnT>(l, function, _unwrap_luaget_optional(std::get<Idxs>(args))...);
+        }(std::make_index_sequence<sizeof...(ArgsT)>());
     }
 
     template <typename...>
@@ -781,6 +2184,11 @@ namespace details
         return _function_call<ReturnT, ArgsT...>(l, function);
     }
 
+    template <typename ReturnT, typename... ArgsT>
+    int _try_function_call_typelist(lua_State* l, auto&& function, _typelist<ArgsT...>) {
+        return _try_function_call<ReturnT, ArgsT...>(l, function);
+    }
+
     template <uint64_t UniqId, typename F, typename ReturnT, typename... ArgsT>
     lua_CFunction _wrap_function(native_function<F, ReturnT, ArgsT...>&& function) {
         auto func = [](lua_State* l, auto&& function) {
@@ -818,6 +2226,146 @@ auto wrap_function(F&& function) {
     return details::_wrap_functional<UniqId>(decltype(&F::operator()){}, function);
 }
 
+/* Closure storage
+ * The callable is placed into a userdata which becomes the only upvalue of the pushed C closure,
+ * so every lua_State owns its own bindings and the call does not touch any static storage
+ */
+template <typename S>
+struct lua_closure {
+    S storage;
+};
+
+template <typename F, typename ReturnT, typename... ArgsT>
+struct function_closure {
+    int call(lua_State* state) {
+        try {
+            if (int rc = details::_function_call<ReturnT, ArgsT...>(state, function); rc != details::lua_result_error)
+                return rc;
+        } catch (const std::exception& e) {
+            details::_push_error_message(state, e.what());
+        }
+        return lua_error(state);
+    }
+
+    F function;
+};
+
+/* Closure without the arity and argument type checks, for the trusted callers only */
+template <typename F, typename ReturnT, typename... ArgsT>
+struct unchecked_function_closure {
+    int call(lua_State* state) {
+        try {
+            if (int rc = details::_unchecked_function_call<ReturnT, ArgsT...>(state, function);
+                rc != details::lua_result_error)
+                return rc;
+        } catch (const std::exception& e) {
+            details::_push_error_message(state, e.what());
+        }
+        return lua_error(state);
+    }
+
+    F function;
+};
+
+/* Closure of the exception-free bindings (the functions returning result<T> or std::expected<T, E>).
+ * The function must be noexcept and report the errors by the return value. The conversions of the arguments
+ * and the push of the value still may throw (bad_alloc, stack_overflow, copy constructors of the usertypes),
+ * they are caught like in function_closure.
+ * The lua error is raised after _result_function_call returns, when the arguments and the result are destroyed
+ */
+template <typename F, typename ReturnT, typename... ArgsT>
+struct result_function_closure {
+    static_assert(std::is_nothrow_invocable_v<F&, ArgsT...>,
+                  "functions returning result<T> or std::expected<T, E> must be noexcept");
+
+    int call(lua_State* state) {
+        try {
+            if (int rc = details::_result_function_call<ReturnT, ArgsT...>(state, function);
+                rc != details::lua_result_error)
+                return rc;
+        } catch (const std::exception& e) {
+            details::_push_error_message(state, e.what());
+        }
+        return lua_error(state);
+    }
+
+    F function;
+};
+
+namespace details
+{
+    template <typename S>
+    int _closure_call(lua_State* l) {
+        return static_cast<S*>(lua_touserdata(l, lua_upvalueindex(1)))->call(l);
+    }
+
+    template <typename S>
+    int _closure_gc(lua_State* l) {
+        static_cast<S*>(lua_touserdata(l, 1))->~S();
+        return 0;
+    }
+
+    template <typename F, typename ReturnT, typename... ArgsT>
+    auto _make_closure(native_function<F, ReturnT, ArgsT...>&& function) {
+        if constexpr (LuaResultLike<std::decay_t<ReturnT>>)
+            return lua_closure<result_function_closure<F, ReturnT, ArgsT...>>{{std::move(function.function)}};
+        else
+            return lua_closure<function_closure<F, ReturnT, ArgsT...>>{{std::move(function.function)}};
+    }
+
+    template <typename F, typename ClassT, typename ReturnT, typename... ArgsT>
+    auto _make_functional_closure(ReturnT (ClassT::*)(ArgsT...) const, F&& function) {
+        return _make_closure(native_function<std::decay_t<F>, ReturnT, ArgsT...>{std::forward<F>(function)});
+    }
+
+    template <typename F, typename ReturnT, typename... ArgsT>
+    auto _make_unchecked_closure(native_function<F, ReturnT, ArgsT...>&& function) {
+        return lua_closure<unchecked_function_closure<F, ReturnT, ArgsT...>>{{std::move(function.function)}};
+    }
+
+    template <typename F, typename ClassT, typename ReturnT, typename... ArgsT>
+    auto _make_unchecked_functional_closure(ReturnT (ClassT::*)(ArgsT...) const, F&& function) {
+        return _make_unchecked_closure(
+            native_function<std::decay_t<F>, ReturnT, ArgsT...>{std::forward<F>(function)});
+    }
+} // namespace details
+
+template <typename ReturnT, typename... ArgsT>
+auto make_closure(ReturnT (*function)(ArgsT...)) {
+    return details::_make_closure(native_function<decltype(function), ReturnT, ArgsT...>{function});
+}
+
+template <typename F>
+    requires details::LuaFunctional<std::decay_t<F>>
+auto make_closure(F&& function) {
+    return details::_make_functional_closure(&std::decay_t<F>::operator(), std::forward<F>(function));
+}
+
+template <typename ReturnT, typename... ArgsT>
+auto make_unchecked_closure(ReturnT (*function)(ArgsT...)) {
+    return details::_make_unchecked_closure(native_function<decltype(function), ReturnT, ArgsT...>{function});
+}
+
+template <typename F>
+    requires details::LuaFunctional<std::decay_t<F>>
+auto make_unchecked_closure(F&& function) {
+    return details::_make_unchecked_functional_closure(&std::decay_t<F>::operator(), std::forward<F>(function));
+}
+
+template <typename S>
+void luapush(lua_State* l, lua_closure<S>&& closure) {
+    new (lua_newuserdata(l, sizeof(S))) S(std::move(closure.storage)); // NOLINT
+
+    if constexpr (!std::is_trivially_destructible_v<S>) {
+        lua_createtable(l, 0, 1);
+        lua_pushcfunction(l, &details::_closure_gc<S>);
+        lua_setfield(l, -2, "__gc");
+        lua_setmetatable(l, -2);
+    }
+
+    lua_pushcclosure(l, &details::_closure_call<S>, 1);
+}
+
 namespace details
 {
     template <typename T>
@@ -880,11 +2428,22 @@ namespace details
     template <typename ReturnT, typename ClassT, typename... ArgsT>
     struct lua_function_traits<ReturnT (ClassT::*)(ArgsT...) const> : lua_function_traits<ReturnT (*)(ArgsT...)> {};
 
+    template <typename ReturnT, typename... ArgsT>
+    struct lua_function_traits<ReturnT (*)(ArgsT...) noexcept> : lua_function_traits<ReturnT (*)(ArgsT...)> {};
+
+    template <typename ReturnT, typename ClassT, typename... ArgsT>
+    struct lua_function_traits<ReturnT (ClassT::*)(ArgsT...) const noexcept>
+        : lua_function_traits<ReturnT (*)(ArgsT...)> {};
+
     template <typename F>
         requires details::LuaFunctional<F>
     struct lua_function_traits<F> : lua_function_traits<decltype(&F::operator())> {
     };
 
+    /* Overloaded closures dispatch over the references to the stored functions */
+    template <typename F>
+    struct lua_function_traits<F&> : lua_function_traits<std::remove_cv_t<F>> {};
+
     template <typename T>
     struct lua_member_function_traits;
 
@@ -914,33 +2473,6 @@ namespace details
     template <size_t>
     struct lua_nttp_tag {};
 
-    template <size_t... Sz>
-    static constexpr bool lua_same_arity = (((Sz + ...) / sizeof...(Sz) == Sz) && ... && true);
-
-    template <typename... Fs>
-    constexpr size_t lua_max_arity() {
-        size_t arity = 0;
-        ((arity = arity < lua_function_traits<Fs>::arity ? lua_function_traits<Fs>::arity : arity), ...);
-        return arity;
-    }
-
-    template <typename... F>
-    struct lua_fold_element {
-        template <typename... F2>
-        auto operator+(const lua_fold_element<F2...>& v) const {
-            return lua_fold_element<F..., F2...>{std::tuple_cat(functions, v.functions)};
-        }
-        std::tuple<F...> functions;
-    };
-
-    template <typename F, size_t Arity>
-    constexpr auto lua_arity_fold(F&& function) {
-        if constexpr (lua_function_traits<F>::arity == Arity)
-            return lua_fold_element<F>{std::tuple<F>{std::forward<F>(function)}};
-        else
-            return lua_fold_element<>{};
-    }
-
     template <typename T, typename... Ts>
     struct lua_first_type {
         using type = T;
@@ -952,106 +2484,75 @@ namespace details
     template <typename... CheckT>
     struct lua_type_list {};
 
-    template <size_t arg_number, bool enable_call, typename F, typename... Fs>
-        requires(lua_function_traits<F>::arity == 0)
-    int lua_overloaded_dispatch_by_arg_types(lua_State* l, F&& function, Fs&&...) {
-        return _function_call_typelist<typename lua_function_traits<F>::return_t>(
-            l, std::forward<F>(function), typename lua_function_traits<F>::arg_types{});
+    /* The number goes to the parameter of the same kind: integer to the integer one (if it fits the range),
+     * float to the float one
+     */
+    template <typename T>
+    bool lua_number_exact_match(lua_State* l, int idx) {
+        if constexpr (LuaIntegerOrRef<T>)
+            return _is_integer_number(l, idx) && _number_fits<T>(l, idx);
+        else if constexpr (LuaFloatOrRef<T>)
+            return !_is_integer_number(l, idx);
+        else
+            return true;
     }
 
-    template <size_t arg_number, bool enable_call, typename F, typename... Fs>
-    int lua_overloaded_dispatch_by_arg_types(lua_State* l, F&& function, Fs&&... functions) {
-        using arg_type = decltype(lua_function_traits<F>::template arg_type<arg_number>().type());
-        constexpr auto same_arg_type =
-            lua_same_types<arg_type, decltype(lua_function_traits<Fs>::template arg_type<arg_number>().type())...>;
-
-        constexpr size_t max_args_count = lua_function_traits<F>::arity;
-
-        if constexpr (sizeof...(Fs) > 0 && same_arg_type) {
-            if constexpr (arg_number + 1 < max_args_count) {
-                return lua_overloaded_dispatch_by_arg_types<arg_number + 1, enable_call>(
-                    l, std::forward<F>(function), std::forward<Fs>(functions)...);
-            }
-            else {
-                /* TODO: fail to select resolution */
-                return -1;
-            }
-        }
-        else {
-            if (luacheck<arg_type>(l, int(arg_number + 1))) {
-                if constexpr (arg_number + 1 < max_args_count) {
-                    int rc = lua_overloaded_dispatch_by_arg_types<arg_number + 1, false>(
-                        l, std::forward<F>(function), std::forward<Fs>(functions)...);
-                    if (rc != -1)
-                        return rc;
-                }
-                return _function_call_typelist<typename lua_function_traits<F>::return_t>(
-                    l, std::forward<F>(function), typename lua_function_traits<F>::arg_types{});
-            }
-
-            /* Take next function if it exists */
-            if constexpr (sizeof...(functions) > 0) {
-                return lua_overloaded_dispatch_by_arg_types<arg_number, enable_call>(l, std::forward<Fs>(functions)...);
-            }
-            else {
-                return -1;
-            }
-        }
+    template <typename... ArgsT, size_t... Idxs>
+    bool lua_numbers_exact_match([[maybe_unused]] lua_State* l, _typelist<ArgsT...>, std::index_sequence<Idxs...>) {
+        return (lua_number_exact_match<ArgsT>(l, int(Idxs + 1)) && ... && true);
     }
 
-    template <size_t CurrentArity = 0, size_t MaxArity, typename A, typename... Fs>
-    int lua_args_count_recursive_dispatch(size_t args_count, A&& acceptor, Fs&&... functions) {
-        if (args_count == CurrentArity) {
-            return acceptor(
-                (lua_arity_fold<Fs, CurrentArity>(std::forward<Fs>(functions)) + ... + lua_fold_element<>{}).functions);
-        }
-        else {
-            if constexpr (CurrentArity + 1 <= MaxArity)
-                return lua_args_count_recursive_dispatch<CurrentArity + 1, MaxArity, A, Fs...>(
-                    args_count, std::forward<A>(acceptor), std::forward<Fs>(functions)...);
-        }
-        return -1;
+    template <typename... ArgsT>
+    constexpr bool _has_number_args(_typelist<ArgsT...>) {
+        return (LuaNumberOrRef<ArgsT> || ... || false);
     }
 
+    /* Overloads set where the integer/float kind of the arguments matters (two or more overloads take numbers) */
     template <typename... Fs>
-    int lua_overloaded_call_dispatch(size_t args_count, lua_State* l, Fs&&... functions) {
-        /* For the first try dispatch by arguments count.
-         * Do this if arity differs only.
-         */
-        if constexpr (!details::lua_same_arity<details::lua_function_traits<Fs>::arity...>) {
-            return details::lua_args_count_recursive_dispatch<0, details::lua_max_arity<Fs...>()>(
-                args_count,
-                [ args_count, l ]<typename... Fs2>(std::tuple<Fs2...> func_tuple) {
-                    /* Call itself with functions with matched arity only */
-                    if constexpr (sizeof...(Fs2) != 0)
-                        return std::apply(lua_overloaded_call_dispatch<Fs2...>,
-                                          std::tuple_cat(std::tuple{args_count, l}, std::move(func_tuple)));
-                    return -1;
-                },
-                std::forward<Fs>(functions)...);
-        }
-        /* Second - dispatch by argument types */
-        else {
-            /* Things become more complex.
-             * We should use the luacheck for every argument with different type
-             */
-            return lua_overloaded_dispatch_by_arg_types<0, true>(l, std::forward<Fs>(functions)...);
-        }
-    }
-
+    static constexpr bool lua_number_overloads =
+        (size_t(_has_number_args(typename lua_function_traits<Fs>::arg_types{})) + ... + 0) > 1;
+
+    /* Calls the first overload (in the order of declaration) with matched arity,
+     * which accepts all the arguments. Every argument is converted once per candidate.
+     * If several overloads take numbers, the one with the exact integer/float kinds of all the numbers
+     * is tried first: f(1) calls f(int64_t), f(1.5) calls f(double) regardless of the declaration order.
+     * In LuaJIT the kind is defined by the value (1.0 is an integer), in lua >= 5.3 by the number subtype
+     */
     template <typename... Fs>
     int lua_overloaded_call_dispatch_entry(lua_State* l, Fs&&... functions) {
         auto args_count = size_t(lua_gettop(l));
-        if (((size_t(args_count) == details::lua_function_traits<Fs>::arity) || ... || false)) {
-            int rc = lua_overloaded_call_dispatch(args_count, l, std::forward<Fs>(functions)...);
-            if (rc == -1)
-                throw errors::call_cpp_error("no matched overloaded function");
-            return rc;
-        }
-        else
+        if (!((args_count == lua_function_traits<Fs>::arity) || ... || false))
             throw errors::call_cpp_error("no matched overloaded function (cannot call with " +
                                          std::to_string(args_count) + " arguments)");
+
+        int rc = -1;
+        if constexpr (lua_number_overloads<Fs...>) {
+            ((lua_function_traits<Fs>::arity == args_count &&
+              lua_numbers_exact_match(l,
+                                      typename lua_function_traits<Fs>::arg_types{},
+                                      std::make_index_sequence<lua_function_traits<Fs>::arity>{}) &&
+              (rc = _try_function_call_typelist<typename lua_function_traits<Fs>::return_t>(
+                   l, functions, typename lua_function_traits<Fs>::arg_types{})) != -1) ||
+             ...);
+            if (rc != -1)
+                return rc;
+        }
+
+        ((lua_function_traits<Fs>::arity == args_count &&
+          (rc = _try_function_call_typelist<typename lua_function_traits<Fs>::return_t>(
+               l, functions, typename lua_function_traits<Fs>::arg_types{})) != -1) ||
+         ...);
+
+        if (rc == -1)
+            throw errors::call_cpp_error("no matched overloaded function");
+        return rc;
+    }
+
+    template <typename... ArgsT, size_t... Idxs>
+    bool lua_args_may_match([[maybe_unused]] lua_State* l, _typelist<ArgsT...>, std::index_sequence<Idxs...>) {
+        return (lua_type_may_match<ArgsT>(l, int(Idxs + 1)) && ... && true);
     }
+
 } // namespace details
 
 template <typename T>
@@ -1067,35 +2568,222 @@ auto wrap_overloaded_functions(Fs&&... functions) {
     return &wrapped_overloaded_function<decltype(func), UniqId, std::decay_t<Fs>...>{}.call;
 }
 
+/* Overloaded closure with the inline cache of the resolutions
+ * The cache is keyed by the lua_type signature of the arguments and remembers the overload,
+ * which is the only one that can accept such a signature (others are rejected by the argument types).
+ * On a hit that overload is called right away, if its arguments are converted successfully.
+ * Signatures with several viable overloads, cache misses after the cache is full (megamorphic binding)
+ * and failed checks go through the full lua_overloaded_call_dispatch_entry
+ */
+template <typename... Fs>
+struct overloaded_function_closure {
+    static constexpr size_t   cache_size       = 4;
+    static constexpr int      max_cached_args  = 15;
+    static constexpr uint32_t generic_dispatch = ~uint32_t(0);
+
+    int call(lua_State* state) {
+        try {
+            if (int rc = dispatch(state); rc != details::lua_result_error)
+                return rc;
+        } catch (const std::exception& e) {
+            details::_push_error_message(state, e.what());
+        }
+        return lua_error(state);
+    }
+
+    int dispatch(lua_State* l) {
+        auto args_count = lua_gettop(l);
+        if (megamorphic || args_count > max_cached_args)
+            return generic_call(l);
+
+        auto signed_key = signature(l, args_count);
+        if (!signed_key)
+            return generic_call(l);
+
+        auto key = *signed_key;
+        for (size_t i = 0; i < cache_count; ++i)
+            if (cache[i].key == key)
+                return cached_call(l, cache[i].index);
+
+        auto index = resolve(l, args_count, std::index_sequence_for<Fs...>{});
+        if (cache_count == cache_size)
+            megamorphic = true;
+        else
+            cache[cache_count++] = {key, index};
+
+        return cached_call(l, index);
+    }
+
+    int generic_call(lua_State* l) const {
+        return std::apply([l](const Fs&... fs) { return details::lua_overloaded_call_dispatch_entry(l, fs...); },
+                          functions);
+    }
+
+    static constexpr bool     number_overloads = details::lua_number_overloads<Fs...>;
+    static constexpr uint64_t integer_code     = 0xF;
+
+    /* The integer fits every integer parameter of the overloads */
+    template <typename... ArgsT>
+    static bool
+    fits_integer_args([[maybe_unused]] lua_State* l, [[maybe_unused]] int idx, details::_typelist<ArgsT...>) {
+        return (details::_number_fits<ArgsT>(l, idx) && ... && true);
+    }
+
+    /* 4 bits per argument type, arguments count in the lowest bits.
+     * The integers have their own code if the overloads are told apart by the kind of the numbers.
+     * The resolution of the integers out of the range of some integer parameter depends on the value,
+     * such calls have no signature and are not cached
+     */
+    static std::optional<uint64_t> signature(lua_State* l, int args_count) {
+        auto key = uint64_t(args_count);
+        for (int i = 1; i <= args_count; ++i) {
+            if (number_overloads && details::_is_integer_number(l, i)) {
+                if (!(fits_integer_args(l, i, typename details::lua_function_traits<Fs>::arg_types{}) && ...))
+                    return std::nullopt;
+                key |= integer_code << (i * 4);
+            }
+            else
+                key |= uint64_t(lua_type(l, i) + 1) << (i * 4);
+        }
+        return key;
+    }
+
+    template <size_t I>
+    using traits = details::lua_function_traits<std::tuple_element_t<I, std::tuple<Fs...>>>;
+
+    template <size_t I>
+    static constexpr auto args_sequence = std::make_index_sequence<traits<I>::arity>{};
+
+    /* The only overload, which may accept the arguments, is cached.
+     * With the integer/float overloads the only exact match by the kind of the numbers is preferred
+     */
+    template <size_t... Is>
+    uint32_t resolve(lua_State* l, int args_count, std::index_sequence<Is...>) const {
+        uint32_t index         = generic_dispatch;
+        size_t   matched       = 0;
+        uint32_t exact_index   = generic_dispatch;
+        size_t   exact_matched = 0;
+        (
+            [&] {
+                if (traits<Is>::arity == size_t(args_count) &&
+                    details::lua_args_may_match(l, typename traits<Is>::arg_types{}, args_sequence<Is>)) {
+                    index = uint32_t(Is);
+                    ++matched;
+                    if (number_overloads &&
+                        details::lua_numbers_exact_match(l, typename traits<Is>::arg_types{}, args_sequence<Is>)) {
+                        exact_index = uint32_t(Is);
+                        ++exact_matched;
+                    }
+                }
+            }(),
+            ...);
+        if (exact_matched == 1)
+            return exact_index;
+        return matched == 1 ? index : generic_dispatch;
+    }
+
+    int cached_call(lua_State* l, uint32_t index) const {
+        if (index != generic_dispatch) {
+            int rc = call_index(l, index, std::index_sequence_for<Fs...>{});
+            if (rc != -1)
+                return rc;
+        }
+        return generic_call(l);
+    }
+
+    template <size_t... Is>
+    int call_index(lua_State* l, uint32_t index, std::index_sequence<Is...>) const {
+        int rc = -1;
+        ((Is == index ? (rc = details::_try_function_call_typelist<typename traits<Is>::return_t>(
+                             l, std::get<Is>(functions), typename traits<Is>::arg_types{}),
+                         true)
+                      : false) ||
+         ...);
+        return rc;
+    }
+
+    struct cache_entry {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    std::tuple<Fs...>                    functions;
+    std::array<cache_entry, cache_size> cache{};
+    size_t                               cache_count = 0;
+    bool                                 megamorphic = false;
+};
+
+template <typename... Fs>
+auto make_overloaded_closure(Fs&&... functions) {
+    return lua_closure<overloaded_function_closure<std::decay_t<Fs>...>>{
+        {std::tuple<std::decay_t<Fs>...>(std::forward<Fs>(functions)...)}};
+}
+
 namespace details
 {
+    /* lua_getfield with the name pushed by _push_name, returns the type of the value */
+    template <typename TName>
+    int _get_named_field(lua_State* l, int idx, const TName& name) {
+        idx = _absindex(l, idx);
+        _push_name(l, name);
+        lua_gettable(l, idx);
+        return lua_type(l, -1);
+    }
+
+    template <typename TName>
+    int _get_named_global(lua_State* l, const TName& name) {
+#if LUA_VERSION_NUM < 502
+        return _get_named_field(l, LUA_GLOBALSINDEX, name);
+#else
+        lua_pushglobaltable(l);
+        auto type = _get_named_field(l, -1, name);
+        lua_remove(l, -2);
+        return type;
+#endif
+    }
+
+    /* Pops the value and assigns it to the global */
+    template <typename TName>
+    void _set_named_global(lua_State* l, const TName& name) {
+#if LUA_VERSION_NUM < 502
+        _push_name(l, name);
+        lua_insert(l, -2);
+        lua_settable(l, LUA_GLOBALSINDEX);
+#else
+        lua_pushglobaltable(l);
+        _push_name(l, name);
+        lua_pushvalue(l, -3);
+        lua_settable(l, -3);
+        lua_pop(l, 2);
+#endif
+    }
+
     template <typename TName>
     decltype(auto) _lua_recursive_provide_namespaced_value(TName name, lua_State* l, auto&& value) {
         constexpr auto dotsplit = name.template divide_by(int_const<'.'>{});
         if constexpr (dotsplit) {
             static_assert(dotsplit.left().size() > 0, "Attempt to declare lua table with empty name");
-            lua_getfield(l, -1, dotsplit.left().data());
-            if (lua_type(l, -1) != LUA_TTABLE) {
+            if (_get_named_field(l, -1, dotsplit.left()) != LUA_TTABLE) {
                 lua_pop(l, 1);
                 lua_newtable(l);
-                lua_pushstring(l, dotsplit.left().data());
+                _push_name(l, dotsplit.left());
                 lua_pushvalue(l, -2);
                 lua_rawset(l, -4);
             }
             auto pop_on_scope_exit = finalizer{[&] {
                 lua_pop(l, 1);
             }};
-            return _lua_recursive_provide_namespaced_value(dotsplit.right(), l, value);
+            return _lua_recursive_provide_namespaced_value(dotsplit.right(), l, std::forward<decltype(value)>(value));
         }
         else {
             static_assert(name.size() > 0, "Attempt to declare lua function with empty name");
-            lua_pushstring(l, name.data());
+            _push_name(l, name);
 
             auto rawset_on_scope_exit = finalizer{[&] {
                 lua_rawset(l, -3);
             }};
 
-            return luapush(l, value);
+            return luapush(l, std::forward<decltype(value)>(value));
         }
     }
 } // namespace details
@@ -1105,43 +2793,49 @@ decltype(auto) luaprovide(TName name, lua_State* l, T&& value) {
     constexpr auto dotsplit = name.template divide_by(int_const<'.'>{});
     if constexpr (dotsplit) {
         static_assert(dotsplit.left().size() > 0, "Attempt to declare lua table with empty name");
-        lua_getglobal(l, dotsplit.left().data());
-        if (lua_type(l, -1) != LUA_TTABLE) {
+        if (details::_get_named_global(l, dotsplit.left()) != LUA_TTABLE) {
             lua_pop(l, 1);
             lua_newtable(l);
             lua_pushvalue(l, -1);
-            lua_setglobal(l, dotsplit.left().data());
+            details::_set_named_global(l, dotsplit.left());
         }
 
         auto pop_on_scope_exit = finalizer{[&] {
             lua_pop(l, 1);
         }};
 
-        return details::_lua_recursive_provide_namespaced_value(dotsplit.right(), l, value);
+        return details::_lua_recursive_provide_namespaced_value(dotsplit.right(), l, std::forward<T>(value));
     }
     else {
         static_assert(name.size() > 0, "Attempt to declare lua function with empty name");
         auto setglobal = finalizer{[&] {
-            lua_setglobal(l, name.data());
+            details::_set_named_global(l, name);
         }};
-        return luapush(l, value);
+        return luapush(l, std::forward<T>(value));
     }
 }
 
+/* The functions are provided as the C closures owned by the lua_State, so there is no lua_CFunction to return
+ * (it returned the static wrapper before). The static wrapper is still available and may be provided as a value:
+ * auto lua_func = wrap_function<name.hash()>(function); luaprovide(name, l, lua_func);
+ */
 template <LuaFunctionLike F, typename TName>
-lua_CFunction luaprovide(TName name, lua_State* l, F&& function) {
-    constexpr auto hash     = name.hash();
-    auto           lua_func = wrap_function<hash>(std::forward<F>(function));
-    luaprovide(name, l, lua_func);
-    return lua_func;
+void luaprovide(TName name, lua_State* l, F&& function) {
+    luaprovide(name, l, make_closure(std::forward<F>(function)));
 }
 
 template <typename TName, LuaFunctionLike... Fs>
-lua_CFunction luaprovide_overloaded(TName name, lua_State* l, Fs&&... functions) {
-    constexpr auto hash     = name.hash();
-    auto           lua_func = wrap_overloaded_functions<hash>(std::forward<Fs>(functions)...);
-    luaprovide(name, l, lua_func);
-    return lua_func;
+void luaprovide_overloaded(TName name, lua_State* l, Fs&&... functions) {
+    luaprovide(name, l, make_overloaded_closure(std::forward<Fs>(functions)...));
+}
+
+/* Provides the function without the arity and argument type checks:
+ * numbers, booleans, strings and usertypes are read with the raw lua_to* conversions.
+ * Calling it with the wrong arguments is undefined behavior, use only for the hot functions called by trusted scripts
+ */
+template <typename F, typename TName>
+void luaprovide_unchecked(TName name, lua_State* l, F&& function) {
+    luaprovide(name, l, make_unchecked_closure(std::forward<F>(function)));
 }
 
 namespace details
@@ -1185,25 +2879,19 @@ namespace details
               typename ClassT,
               typename TName,
               typename... ArgsT>
-    lua_CFunction _luaprovide_member_function(TName name, lua_State* l, F member_function) {
+    void _luaprovide_member_function(TName name, lua_State* l, F member_function) {
         constexpr auto typespec = type_registry::get_typespec<ClassT>();
         constexpr auto fullname = typespec.lua_name().dot(name);
-        constexpr auto hash     = fullname.hash();
-        auto           lua_func = wrap_function<hash>(member_wrapper{member_function});
-        luaprovide(fullname, l, lua_func);
-        return lua_func;
+        luaprovide(fullname, l, make_closure(member_wrapper{member_function}));
     }
 
     template <typename TName, typename... Fs>
         requires lua_same_types<typename lua_member_function<Fs>::class_t...>
-    lua_CFunction _luaprovide_overloaded_member_function(TName name, lua_State* l, Fs... functions) {
+    void _luaprovide_overloaded_member_function(TName name, lua_State* l, Fs... functions) {
         constexpr auto typespec = type_registry::get_typespec<
             typename lua_first_type<typename lua_member_function<Fs>::class_t...>::type>();
         constexpr auto fullname = typespec.lua_name().dot(name);
-        constexpr auto hash     = fullname.hash();
-        auto           lua_func = wrap_overloaded_functions<hash>(member_wrapper{functions}...);
-        luaprovide(fullname, l, lua_func);
-        return lua_func;
+        luaprovide(fullname, l, make_overloaded_closure(member_wrapper{functions}...));
     }
 
 } // namespace details
@@ -1213,35 +2901,35 @@ namespace details
  */
 
 template <typename ReturnT, typename ClassT, typename TName, typename... ArgsT>
-lua_CFunction luaprovide(TName name, lua_State* l, ReturnT (ClassT::*member_function)(ArgsT...)) {
+void luaprovide(TName name, lua_State* l, ReturnT (ClassT::*member_function)(ArgsT...)) {
     return details::
         _luaprovide_member_function<false, false, decltype(member_function), ReturnT, ClassT, TName, ArgsT...>(
             name, l, member_function);
 }
 
 template <typename ReturnT, typename ClassT, typename TName, typename... ArgsT>
-lua_CFunction luaprovide(TName name, lua_State* l, ReturnT (ClassT::*member_function)(ArgsT...) const) {
+void luaprovide(TName name, lua_State* l, ReturnT (ClassT::*member_function)(ArgsT...) const) {
     return details::
         _luaprovide_member_function<false, true, decltype(member_function), ReturnT, ClassT, TName, ArgsT...>(
             name, l, member_function);
 }
 
 template <typename ReturnT, typename ClassT, typename TName, typename... ArgsT>
-lua_CFunction luaprovide(TName name, lua_State* l, ReturnT (ClassT::*member_function)(ArgsT...) noexcept) {
+void luaprovide(TName name, lua_State* l, ReturnT (ClassT::*member_function)(ArgsT...) noexcept) {
     return details::
         _luaprovide_member_function<true, false, decltype(member_function), ReturnT, ClassT, TName, ArgsT...>(
             name, l, member_function);
 }
 
 template <typename ReturnT, typename ClassT, typename TName, typename... ArgsT>
-lua_CFunction luaprovide(TName name, lua_State* l, ReturnT (ClassT::*member_function)(ArgsT...) const noexcept) {
+void luaprovide(TName name, lua_State* l, ReturnT (ClassT::*member_function)(ArgsT...) const noexcept) {
     return details::
         _luaprovide_member_function<true, true, decltype(member_function), ReturnT, ClassT, TName, ArgsT...>(
             name, l, member_function);
 }
 
 template <typename TName, LuaMemberFunction... Fs>
-lua_CFunction luaprovide_overloaded(TName name, lua_State* l, Fs... functions) {
+void luaprovide_overloaded(TName name, lua_State* l, Fs... functions) {
     return details::_luaprovide_overloaded_member_function(name, l, functions...);
 }
 
@@ -1280,13 +2968,8 @@ int luaaccess(NameT&& name, lua_State* l, int stack_depth = 0, int prev_type = L
 
         ++stack_depth;
 
-#if (LUA_VERSION_NUM < 502)
-        lua_getfield(l, stack_depth == 1 ? LUA_GLOBALSINDEX : -1, dotsplit.left().data());
-        prev_type = lua_type(l, -1);
-#else
-        prev_type = stack_depth == 1 ? lua_getglobal(l, dotsplit.left().data())
-                                     : lua_getfield(l, -1, dotsplit.left().data());
-#endif
+        prev_type = stack_depth == 1 ? details::_get_named_global(l, dotsplit.left())
+                                     : details::_get_named_field(l, -1, dotsplit.left());
 
         guard.dismiss();
         return luaaccess(dotsplit.right(), l, stack_depth, prev_type);
@@ -1294,14 +2977,10 @@ int luaaccess(NameT&& name, lua_State* l, int stack_depth = 0, int prev_type = L
     else {
         poly_assert(name.size() > 0, "Attempt to access lua variable with empty name");
         ++stack_depth;
-#if (LUA_VERSION_NUM < 502)
-        lua_getfield(l, stack_depth == 1 ? LUA_GLOBALSINDEX : -1, name.data());
-#else
         if (stack_depth == 1)
-            lua_getglobal(l, name.data());
+            details::_get_named_global(l, name);
         else
-            lua_getfield(l, -1, name.data());
-#endif
+            details::_get_named_field(l, -1, name);
         return stack_depth;
     }
 }
@@ -1319,43 +2998,6 @@ decltype(auto) luaextract(NameT&& name, lua_State* l) {
     return luaget<T>(l, -1);
 }
 
-template <typename... ArgsT>
-struct multiresult {
-    static constexpr size_t count = sizeof...(ArgsT);
-
-    multiresult(lua_State* l):
-        storage([]<size_t... Idxs>(lua_State * l, std::index_sequence<Idxs...>) {
-            static constexpr auto sz = sizeof...(ArgsT);
-            return std::tuple<ArgsT...>(luaget<ArgsT>(l, -int(sz - Idxs))...);
-        }(l, std::make_index_sequence<sizeof...(ArgsT)>())) {}
-
-    template <size_t N>
-    constexpr decltype(auto) get() {
-        return std::get<N>(storage);
-    }
-    template <size_t N>
-    constexpr decltype(auto) get() const {
-        return std::get<N>(storage);
-    }
-
-    constexpr size_t size() const {
-        return sizeof...(ArgsT);
-    }
-
-    std::tuple<ArgsT...> storage;
-};
-
-namespace details
-{
-    template <typename T>
-    struct is_multiresult : std::false_type {};
-    template <typename... Ts>
-    struct is_multiresult<multiresult<Ts...>> : std::true_type {};
-} // namespace details
-
-template <typename T>
-concept LuaMultiresult = details::is_multiresult<T>::value;
-
 template <typename TName, typename ReturnT>
 class lua_function_base {
 public:
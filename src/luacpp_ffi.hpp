@@ -0,0 +1,341 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "luacpp_details.hpp"
+
+namespace luacpp
+{
+
+namespace errors
+{
+    class ffi_error : public std::runtime_error {
+    public:
+        ffi_error(const std::string& msg): std::runtime_error("luacpp: " + msg) {}
+    };
+} // namespace errors
+
+/* Usertypes are accepted only if they are FFI structs (the cdata points to T), the userdata of other usertypes
+ * starts with the type header, so LuaJIT would pass the address of the header instead of T
+ */
+template <typename T>
+concept LuaFfiPodPointer =
+    std::is_pointer_v<T> && !std::is_function_v<std::remove_pointer_t<T>> &&
+    (std::is_void_v<std::remove_pointer_t<T>> || (std::is_standard_layout_v<std::remove_pointer_t<T>> &&
+                                                   std::is_trivial_v<std::remove_pointer_t<T>>)) &&
+    (!LuaRegisteredType<std::remove_cv_t<std::remove_pointer_t<T>>> ||
+     details::ffi_struct_enabled<std::remove_cv_t<std::remove_pointer_t<T>>>());
+
+/* long double has no FFI representation */
+template <typename T>
+concept LuaFfiArgument = LuaInteger<T> || std::same_as<T, float> || std::same_as<T, double> ||
+                         std::same_as<T, bool> || LuaFfiPodPointer<T>;
+
+template <typename T>
+concept LuaFfiReturn = std::is_void_v<T> || LuaFfiArgument<T>;
+
+/* Free function called by LuaJIT through the FFI function pointer (see luaprovide_ffi)
+ * The call is compiled into the trace, the function must be noexcept and can't access the lua_State
+ */
+template <typename ReturnT, typename... ArgsT>
+    requires LuaFfiReturn<ReturnT> && (LuaFfiArgument<ArgsT> && ...)
+struct ffi_function {
+    ReturnT (*function)(ArgsT...) noexcept;
+};
+
+template <typename ReturnT, typename... ArgsT>
+ffi_function(ReturnT (*)(ArgsT...) noexcept) -> ffi_function<ReturnT, ArgsT...>;
+
+template <typename T>
+concept LuaFfiFunction = requires(T function) {
+    ffi_function{function};
+};
+
+namespace details
+{
+    /* The ctype name of the FFI struct (see luaregister_ffi_struct) */
+    template <typename T>
+    std::string _ffi_struct_name() {
+        auto name = "luacpp_" + std::string(type_registry::get_typespec<T>().lua_name().data());
+        std::replace(name.begin(), name.end(), '.', '_');
+        return name;
+    }
+
+    template <typename T>
+    std::string _ffi_ctype() {
+        if constexpr (std::is_void_v<T>)
+            return "void";
+        else if constexpr (std::same_as<T, bool>)
+            return "bool";
+        else if constexpr (std::same_as<T, char>)
+            return "char";
+        else if constexpr (std::same_as<T, float>)
+            return "float";
+        else if constexpr (std::same_as<T, double>)
+            return "double";
+        else if constexpr (LuaInteger<T>)
+            return std::string(std::is_signed_v<T> ? "int" : "uint") + std::to_string(sizeof(T) * 8) + "_t";
+        else {
+            /* Pointers to the numbers and the FFI structs keep the element type, other POD types are passed as void*.
+             * The FFI struct must be registered before the function is provided
+             */
+            using pointee = std::remove_pointer_t<T>;
+            using element = std::remove_cv_t<pointee>;
+            auto  ctype   = std::string(std::is_const_v<pointee> ? "const " : "");
+            if constexpr (std::is_arithmetic_v<element>)
+                return ctype + _ffi_ctype<element>() + '*';
+            else if constexpr (LuaRegisteredType<element>)
+                return ctype + _ffi_struct_name<element>() + '*';
+            else
+                return ctype + "void*";
+        }
+    }
+
+    template <typename ReturnT, typename... ArgsT>
+    std::string _ffi_signature() {
+        auto signature = _ffi_ctype<ReturnT>() + "(*)(";
+        ((signature += _ffi_ctype<ArgsT>() + ", "), ...);
+        if constexpr (sizeof...(ArgsT) > 0)
+            signature.resize(signature.size() - 2);
+        return signature + ')';
+    }
+
+    template <typename T>
+    constexpr bool _ffi_closure_argument = requires(lua_State* l) { luaget<T>(l, 1); };
+
+    /* Without the FFI the function is provided as the regular closure, if all the arguments can be read by luaget */
+    template <typename ReturnT, typename... ArgsT>
+    constexpr bool ffi_closure_fallback = !LuaFfiPodPointer<ReturnT> && (_ffi_closure_argument<ArgsT> && ...);
+
+    inline bool _ffi_available([[maybe_unused]] lua_State* l) {
+#ifdef WITH_LUAJIT
+        if (luaL_loadstring(l, "return require('ffi')") != 0) {
+            lua_pop(l, 1);
+            return false;
+        }
+        bool available = lua_pcall(l, 0, 1, 0) == 0;
+        lua_pop(l, 1);
+        return available;
+#else
+        return false;
+#endif
+    }
+
+#ifdef WITH_LUAJIT
+    inline constexpr auto _ffi_cast_function = R"(
+        local signature, address = ...
+        return require("ffi").cast(signature, address)
+    )";
+
+    /* The function pointer is passed as light userdata and casted to the cdata function pointer */
+    inline bool _push_ffi_function(lua_State* l, const std::string& signature, void* address) {
+        if (luaL_loadstring(l, _ffi_cast_function) != 0) {
+            lua_pop(l, 1);
+            return false;
+        }
+        lua_pushlstring(l, signature.data(), signature.size());
+        lua_pushlightuserdata(l, address);
+        if (lua_pcall(l, 2, 1, 0) != 0) {
+            lua_pop(l, 1);
+            return false;
+        }
+        return true;
+    }
+#endif
+} // namespace details
+
+template <typename ReturnT, typename... ArgsT>
+void luapush(lua_State* l, const ffi_function<ReturnT, ArgsT...>& function) {
+#ifdef WITH_LUAJIT
+    if (details::_push_ffi_function(l,
+                                    details::_ffi_signature<ReturnT, ArgsT...>(),
+                                    reinterpret_cast<void*>(function.function))) // NOLINT
+        return;
+#endif
+    if constexpr (details::ffi_closure_fallback<ReturnT, ArgsT...>)
+        luapush(l, make_closure(function.function));
+    else
+        throw errors::ffi_error("LuaJIT FFI is required for the function with the signature " +
+                                details::_ffi_signature<ReturnT, ArgsT...>());
+}
+
+/* Field of the usertype described as the FFI struct (see luaregister_ffi_struct) */
+template <typename T>
+struct ffi_struct_field {
+    std::string name;
+    std::string ctype;
+    size_t      offset;
+    size_t      size;
+};
+
+template <typename T>
+using ffi_struct_fields = std::vector<ffi_struct_field<T>>;
+
+template <typename T, typename M>
+    requires LuaFfiArgument<M> && (!std::is_pointer_v<M>)
+ffi_struct_field<T> ffi_field(std::string name, M T::*member) {
+    /* offsetof does not accept the member pointer, the offset is taken on the uninitialized storage */
+    alignas(T) unsigned char storage[sizeof(T)];
+    auto object = reinterpret_cast<T*>(storage); // NOLINT
+    auto offset = size_t(reinterpret_cast<unsigned char*>(&(object->*member)) - storage); // NOLINT
+    return {std::move(name), details::_ffi_ctype<M>(), offset, sizeof(M)};
+}
+
+namespace details
+{
+    /* typedef struct { <fields in the offset order with the explicit padding> } <name>; */
+    template <typename T>
+    std::string _ffi_struct_cdef(const std::string& name, ffi_struct_fields<T> fields) {
+        std::sort(fields.begin(), fields.end(), [](auto& lhs, auto& rhs) { return lhs.offset < rhs.offset; });
+
+        auto   cdef     = std::string("typedef struct ");
+        size_t position = 0;
+        size_t padding  = 0;
+
+        /* The field types are aligned at most by 8 */
+        if constexpr (alignof(T) > alignof(double))
+            cdef += "__attribute__((aligned(" + std::to_string(alignof(T)) + "))) ";
+        cdef += "{ ";
+
+        auto pad = [&](size_t offset) {
+            if (offset > position)
+                cdef += "uint8_t _luacpp_pad" + std::to_string(padding++) + "[" + std::to_string(offset - position) +
+                        "]; ";
+        };
+
+        for (auto& field : fields) {
+            if (field.offset < position)
+                throw errors::ffi_error("field '" + field.name + "' overlaps the previous field");
+            pad(field.offset);
+            cdef += field.ctype + ' ' + field.name + "; ";
+            position = field.offset + field.size;
+        }
+        pad(sizeof(T));
+
+        return cdef + "} " + name + ";";
+    }
+
+    inline constexpr auto _ffi_struct_register = R"(
+        local name, cdef, size, offsets, class = ...
+        local ffi = require("ffi")
+
+        local defined, ct = pcall(ffi.typeof, name)
+        if not defined then
+            ffi.cdef(cdef)
+            ct = ffi.typeof(name)
+
+            -- The metatype is fixed, so the metamethods are looked up in the class table at the call time
+            local mt = {__index = class}
+            local function forward(event)
+                mt[event] = function(a, b)
+                    local f = rawget(class, event)
+                    if f == nil then
+                        error(name .. " has no " .. event .. " metamethod", 2)
+                    end
+                    return f(a, b)
+                end
+            end
+            for _, event in ipairs({"__add", "__sub", "__mul", "__div", "__mod", "__pow", "__unm", "__lt", "__le",
+                                    "__concat"}) do
+                forward(event)
+            end
+            for _, event in ipairs({"__len", "__call", "__tostring"}) do
+                if rawget(class, event) ~= nil then
+                    forward(event)
+                end
+            end
+            mt.__eq = function(a, b)
+                local f = rawget(class, "__eq")
+                if f == nil then
+                    return rawequal(a, b)
+                end
+                return f(a, b)
+            end
+            ffi.metatype(ct, mt)
+        end
+
+        if ffi.sizeof(ct) ~= size then
+            error(name .. " size mismatch: " .. tostring(ffi.sizeof(ct)) .. " but should be " .. tostring(size))
+        end
+        for field, offset in pairs(offsets) do
+            if ffi.offsetof(ct, field) ~= offset then
+                error(name .. "." .. field .. " offset mismatch")
+            end
+        end
+
+        class.ctype = ct
+        local istype = ffi.istype
+        return ct, function(v) return istype(ct, v) end
+    )";
+} // namespace details
+
+/* Describes the usertype as the FFI struct: the fields are declared with ffi.cdef and the ctype gets the metatype,
+ * which forwards the methods and metamethods to the usertype class table.
+ * After that the values of T are pushed as cdata, lua can create them with <class>.ctype(...), the field access
+ * is compiled by LuaJIT. C++ functions accept the cdata as T, T& and T*.
+ * Returns false without LuaJIT FFI, the values are pushed as userdata then
+ */
+template <typename T>
+bool luaregister_ffi_struct(lua_State* l, const ffi_struct_fields<T>& fields) {
+    static_assert(decltype(type_registry::get_typespec<T>())::has_ffi_struct(),
+                  "The typespec of the type must have the ffi_struct option");
+    static_assert(std::is_trivially_copyable_v<T> && std::is_standard_layout_v<T>,
+                  "FFI struct must be trivially copyable and standard-layout");
+
+    if (!details::_ffi_available(l))
+        return false;
+
+    auto name = details::_ffi_struct_name<T>();
+
+    if (luaL_loadstring(l, details::_ffi_struct_register) != 0) {
+        auto error = std::string(lua_tostring(l, -1));
+        lua_pop(l, 1);
+        throw errors::ffi_error(error);
+    }
+
+    luapush(l, name);
+    luapush(l, details::_ffi_struct_cdef<T>(name, fields));
+    lua_pushnumber(l, lua_Number(sizeof(T)));
+    lua_createtable(l, 0, int(fields.size()));
+    for (auto& field : fields) {
+        lua_pushnumber(l, lua_Number(field.offset));
+        lua_setfield(l, -2, field.name.data());
+    }
+    details::_push_usertype_metatable<T>(l);
+
+    if (lua_pcall(l, 5, 2, 0) != 0) {
+        auto error = std::string(lua_tostring(l, -1));
+        lua_pop(l, 1);
+        throw errors::ffi_error(error);
+    }
+
+    luaregistry_set(l, &details::ffi_struct_istype_key<T>);
+    luaregistry_set(l, &details::ffi_struct_ctype_key<T>);
+    return true;
+}
+
+/* Provides the noexcept free function (or the captureless lambda) as the FFI function pointer under LuaJIT,
+ * so the calls from the hot loops are JIT-compiled. The signature may contain only numbers, bool and pointers
+ * to POD types (the usertypes must be FFI structs). 64-bit integers are returned as boxed cdata by FFI.
+ * Other lua implementations get the regular closure
+ */
+template <typename TName, typename F>
+    requires LuaFfiFunction<decltype(+std::declval<F>())>
+void luaprovide_ffi(TName name, lua_State* l, F&& function) {
+    auto ffi = ffi_function{+function};
+
+    /* Checked before luaprovide, so the failed push does not leave the global half-assigned */
+    [&]<typename ReturnT, typename... ArgsT>(const ffi_function<ReturnT, ArgsT...>&) {
+        if constexpr (!details::ffi_closure_fallback<ReturnT, ArgsT...>)
+            if (!details::_ffi_available(l))
+                throw errors::ffi_error("LuaJIT FFI is required for the function with the signature " +
+                                        details::_ffi_signature<ReturnT, ArgsT...>());
+    }(ffi);
+
+    luaprovide(name, l, ffi);
+}
+
+} // namespace luacpp
@@ -15,6 +15,8 @@ extern "C" {
 
 #if LUA_VERSION_NUM >= 502
     #define lua_objlen(state, idx) lua_rawlen(state, idx)
+#else
+    #define lua_pushglobaltable(state) lua_pushvalue(state, LUA_GLOBALSINDEX)
 #endif
 
 namespace luacpp
@@ -25,8 +27,68 @@ namespace errors
     public:
         panic(const char* msg): std::runtime_error(msg) {}
     };
+
+    class stack_overflow : public std::runtime_error {
+    public:
+        stack_overflow(): std::runtime_error("luacpp: cannot grow lua stack") {}
+    };
 } // namespace errors
 
+/* Identifies the lua build which produced a bytecode */
+#ifdef WITH_LUAJIT
+    #define LUACPP_LUA_VARIANT "luajit " LUAJIT_VERSION
+#else
+    #define LUACPP_LUA_VARIANT "lua " LUA_RELEASE
+#endif
+
+/* Loads the precompiled chunk only (the mode argument is not supported by lua 5.1 and LuaJIT,
+ * they recognize the chunk type by its signature)
+ */
+inline int luaload_binary(lua_State* l, const char* data, size_t size, const char* chunkname) {
+#if LUA_VERSION_NUM >= 502
+    return luaL_loadbufferx(l, data, size, chunkname, "b");
+#else
+    return luaL_loadbuffer(l, data, size, chunkname);
+#endif
+}
+
+inline int luaload_reader(lua_State* l, lua_Reader reader, void* data, const char* chunkname) {
+#if LUA_VERSION_NUM >= 502
+    return lua_load(l, reader, data, chunkname, nullptr);
+#else
+    return lua_load(l, reader, data, chunkname);
+#endif
+}
+
+inline int luadump(lua_State* l, lua_Writer writer, void* data) {
+#if LUA_VERSION_NUM >= 503
+    return lua_dump(l, writer, data, 0);
+#else
+    return lua_dump(l, writer, data);
+#endif
+}
+
+/* Registry slots keyed by the address of some static object */
+inline void luaregistry_get(lua_State* l, const void* key) {
+#if LUA_VERSION_NUM >= 502
+    lua_rawgetp(l, LUA_REGISTRYINDEX, key);
+#else
+    lua_pushlightuserdata(l, const_cast<void*>(key)); // NOLINT
+    lua_rawget(l, LUA_REGISTRYINDEX);
+#endif
+}
+
+/* Pops the value from the stack */
+inline void luaregistry_set(lua_State* l, const void* key) {
+#if LUA_VERSION_NUM >= 502
+    lua_rawsetp(l, LUA_REGISTRYINDEX, key);
+#else
+    lua_pushlightuserdata(l, const_cast<void*>(key)); // NOLINT
+    lua_insert(l, -2);
+    lua_rawset(l, LUA_REGISTRYINDEX);
+#endif
+}
+
 inline void luacall(lua_State* l, int nargs, int nresults) {
     auto rc = lua_pcall(l, nargs, nresults, 0);
     switch (rc) {
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <utility>
+
+#if __has_include(<sys/mman.h>)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #define LUACPP_HAS_MMAP 1
+#else
+    #define LUACPP_HAS_MMAP 0
+#endif
+
+#include "luacpp_lib.hpp"
+
+namespace luacpp
+{
+
+/* Read-only memory mapping of a regular file
+ * The mapping is empty (and the caller should fall back to the plain file reading)
+ * if the file is not a regular one (pipes, devices), is empty, or mmap is not available
+ */
+class mapped_file {
+public:
+    mapped_file() = default;
+
+    explicit mapped_file(const char* path) {
+#if LUACPP_HAS_MMAP
+        int fd = ::open(path, O_RDONLY | O_CLOEXEC); // NOLINT
+        if (fd < 0)
+            return;
+
+        struct stat st {};
+        if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            auto  size = size_t(st.st_size);
+            void* addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) { // NOLINT
+                ::madvise(addr, size, MADV_SEQUENTIAL);
+                ptr = static_cast<const char*>(addr);
+                len = size;
+            }
+        }
+        ::close(fd);
+#else
+        (void)path;
+#endif
+    }
+
+    mapped_file(mapped_file&& f) noexcept: ptr(std::exchange(f.ptr, nullptr)), len(std::exchange(f.len, 0)) {}
+
+    mapped_file& operator=(mapped_file&& f) noexcept {
+        if (&f != this) {
+            unmap();
+            ptr = std::exchange(f.ptr, nullptr);
+            len = std::exchange(f.len, 0);
+        }
+        return *this;
+    }
+
+    ~mapped_file() {
+        unmap();
+    }
+
+    [[nodiscard]]
+    bool is_mapped() const {
+        return ptr != nullptr;
+    }
+
+    [[nodiscard]]
+    std::string_view view() const {
+        return {ptr, len};
+    }
+
+private:
+    void unmap() {
+#if LUACPP_HAS_MMAP
+        if (ptr)
+            ::munmap(const_cast<char*>(ptr), len); // NOLINT
+#endif
+        ptr = nullptr;
+        len = 0;
+    }
+
+private:
+    const char* ptr = nullptr;
+    size_t      len = 0;
+};
+
+namespace details
+{
+    /* Zero-copy lua_Reader: hands out the whole buffer at once */
+    struct _view_reader {
+        std::string_view data;
+
+        static const char* read(lua_State*, void* self, size_t* size) {
+            auto reader = static_cast<_view_reader*>(self);
+            *size       = reader->data.size();
+            auto result = reader->data.data();
+            reader->data = {};
+            return *size ? result : nullptr;
+        }
+    };
+
+    /* luaL_loadfile skips the unix exec line, the newline is kept for the correct line numbers */
+    inline std::string_view _skip_shebang(std::string_view source) {
+        if (source.starts_with('#')) {
+            auto nl = source.find('\n');
+            return nl == std::string_view::npos ? std::string_view{} : source.substr(nl);
+        }
+        return source;
+    }
+} // namespace details
+
+} // namespace luacpp
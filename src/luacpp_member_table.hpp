@@ -1,9 +1,15 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <map>
+#include <memory>
 #include <vector>
 #include <string>
 
+#include "luacpp_lib.hpp"
+
 #define lua_getsetez(lua_or_cpp_name)                                                                                  \
     {                                                                                                                  \
         #lua_or_cpp_name, {                                                                                            \
@@ -77,9 +83,138 @@ struct getset {
 };
 
 template <typename T>
-using member_table = std::map<std::string, getset<T>>;
+using member_table = std::map<std::string, getset<T>, std::less<>>;
+
+/* Lookup order of the usertype __index after the member table is set
+ * fields_first: every key goes to the C++ field resolver, methods are looked up after the fields miss
+ * methods_first: the methods are looked up with the plain table access, only the other keys reach the C++ resolver.
+ *                A method shadows the field with the same name
+ */
+enum class member_lookup { fields_first, methods_first };
 
 template <typename T>
 using ordered_member_table = std::vector<std::pair<std::string, getset<T>>>;
 
+/* Member table with the field names interned in the lua state (see luactx::set_member_table)
+ * __index and __newindex match the field by the pointer of the interned lua string, without any allocation
+ */
+template <typename T>
+struct interned_member_table {
+    interned_member_table() = default;
+    interned_member_table(std::initializer_list<std::pair<std::string, getset<T>>> ifields): fields(ifields) {}
+    interned_member_table(ordered_member_table<T> ifields): fields(std::move(ifields)) {}
+    interned_member_table(const member_table<T>& ifields): fields(ifields.begin(), ifields.end()) {}
+
+    ordered_member_table<T> fields;
+};
+
+namespace details
+{
+    /* Registry key of the table that keeps the interned field names of T alive */
+    template <typename T>
+    inline constexpr char interned_fields_anchor_key = 0;
+
+    /* Field name -> getset mapping keyed by the interned lua string pointers
+     * Uses a perfect hash of the pointers, which is searched once when the table is set
+     */
+    template <typename T>
+    class interned_field_map {
+    public:
+        /* Lua 5.2+ interns only the short strings, the longer ones are compared by value */
+        static constexpr size_t max_interned_length = LUA_VERSION_NUM >= 502 ? 40 : size_t(-1);
+
+        interned_field_map(lua_State* l, ordered_member_table<T> ifields): fields(std::move(ifields)) {
+            keys.reserve(fields.size());
+
+            lua_createtable(l, int(fields.size()), 0);
+            for (size_t i = 0; i < fields.size(); ++i) {
+                auto& name = fields[i].first;
+                lua_pushlstring(l, name.data(), name.size());
+                keys.push_back(name.size() > max_interned_length ? nullptr : lua_tostring(l, -1));
+                lua_rawseti(l, -2, int(i + 1));
+            }
+            luaregistry_set(l, &interned_fields_anchor_key<T>);
+
+            build_hash();
+        }
+
+        const getset<T>* find(lua_State* l, int idx) const {
+            if (lua_type(l, idx) != LUA_TSTRING)
+                return nullptr;
+
+            size_t len;
+            auto   key = lua_tolstring(l, idx, &len);
+
+            if (!slots.empty()) {
+                auto slot = slots[hash(key)];
+                if (slot != no_slot && keys[slot] == key)
+                    return &fields[slot].second;
+            }
+            else {
+                for (size_t i = 0; i < keys.size(); ++i)
+                    if (keys[i] == key)
+                        return &fields[i].second;
+            }
+
+            if (len > max_interned_length)
+                for (auto& [name, field] : fields)
+                    if (name.size() == len && std::memcmp(name.data(), key, len) == 0)
+                        return &field;
+
+            return nullptr;
+        }
+
+        const ordered_member_table<T>& entries() const {
+            return fields;
+        }
+
+    private:
+        static constexpr auto no_slot = uint32_t(-1);
+
+        size_t hash(const char* key) const {
+            return size_t((uint64_t(reinterpret_cast<uintptr_t>(key)) * multiplier) >> shift); // NOLINT
+        }
+
+        void build_hash() {
+            size_t count = 0;
+            for (auto key : keys) count += key != nullptr;
+            if (count == 0)
+                return;
+
+            /* Multiplicative hashing with the growing table size, until some multiplier gives no collisions */
+            unsigned bits = 1;
+            while ((size_t(1) << bits) < count * 2) ++bits;
+
+            for (; bits <= 16; ++bits) {
+                shift = 64 - bits;
+                slots.assign(size_t(1) << bits, no_slot);
+                multiplier = 0x9e3779b97f4a7c15ULL;
+
+                for (int attempt = 0; attempt < 64; ++attempt, multiplier += 0x2545f4914f6cdd1eULL) {
+                    std::fill(slots.begin(), slots.end(), no_slot);
+                    bool collision = false;
+                    for (uint32_t i = 0; i < keys.size() && !collision; ++i) {
+                        if (!keys[i])
+                            continue;
+                        auto& slot = slots[hash(keys[i])];
+                        collision  = slot != no_slot;
+                        slot       = i;
+                    }
+                    if (!collision)
+                        return;
+                }
+            }
+
+            /* Linear search through the pointers */
+            slots.clear();
+        }
+
+        ordered_member_table<T>  fields;
+        std::vector<const char*> keys;
+        std::vector<uint32_t>    slots;
+        uint64_t                 multiplier = 0;
+        unsigned                 shift      = 64;
+    };
+} // namespace details
+
 } // namespace luacpp
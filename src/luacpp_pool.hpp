@@ -0,0 +1,163 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "luacpp_ctx.hpp"
+
+namespace luacpp {
+
+/* Pool of pre-warmed lua states
+ * Every state is built once by the setup callback, after that its global table is snapshotted.
+ * When a lease is returned, the globals are restored to the snapshot.
+ * The restore is shallow: the tables which were modified in place (e.g. package.loaded) keep the changes
+ */
+class luactx_pool {
+public:
+    using setup_t = std::function<void(luactx&)>;
+
+    class lease {
+    public:
+        lease(luactx_pool* ipool, std::unique_ptr<luactx> ictx): pool(ipool), ctx(std::move(ictx)) {}
+
+        lease(lease&&) noexcept = default;
+
+        lease& operator=(lease&& other) noexcept {
+            if (&other == this)
+                return *this;
+            release();
+            pool = other.pool;
+            ctx  = std::move(other.ctx);
+            return *this;
+        }
+
+        ~lease() {
+            release();
+        }
+
+        luactx& operator*() const {
+            return *ctx;
+        }
+
+        luactx* operator->() const {
+            return ctx.get();
+        }
+
+    private:
+        void release() {
+            if (ctx)
+                pool->release(std::move(ctx));
+        }
+
+    private:
+        luactx_pool*            pool;
+        std::unique_ptr<luactx> ctx;
+    };
+
+    luactx_pool(size_t size, setup_t setup_callback): setup(std::move(setup_callback)) {
+        states.reserve(size);
+        for (size_t i = 0; i < size; ++i) states.push_back(make_state());
+    }
+
+    luactx_pool(const luactx_pool&)            = delete;
+    luactx_pool& operator=(const luactx_pool&) = delete;
+
+    /* Builds a new state if the pool is exhausted */
+    lease checkout() {
+        {
+            auto lock = std::lock_guard{mtx};
+            if (!states.empty()) {
+                auto ctx = std::move(states.back());
+                states.pop_back();
+                return {this, std::move(ctx)};
+            }
+        }
+        return {this, make_state()};
+    }
+
+    [[nodiscard]]
+    size_t available() const {
+        auto lock = std::lock_guard{mtx};
+        return states.size();
+    }
+
+private:
+    std::unique_ptr<luactx> make_state() {
+        auto ctx = std::make_unique<luactx>();
+        setup(*ctx);
+        snapshot_globals(ctx->state());
+        return ctx;
+    }
+
+    void release(std::unique_ptr<luactx> ctx) {
+        restore_globals(ctx->state());
+
+        auto lock = std::lock_guard{mtx};
+        states.push_back(std::move(ctx));
+    }
+
+    static void snapshot_globals(lua_State* l) {
+        lua_settop(l, 0);
+        lua_newtable(l);
+        lua_pushglobaltable(l);
+        lua_pushnil(l);
+        while (lua_next(l, 2)) {
+            lua_pushvalue(l, -2);
+            lua_insert(l, -2);
+            lua_rawset(l, 1);
+        }
+        lua_pop(l, 1);
+        luaregistry_set(l, &snapshot_key);
+    }
+
+    static void restore_globals(lua_State* l) {
+        lua_settop(l, 0);
+        luaregistry_get(l, &snapshot_key);
+        lua_pushglobaltable(l);
+
+        /* Reset changed and remove new globals. Assigning existing fields is allowed while traversing */
+        lua_pushnil(l);
+        while (lua_next(l, 2)) {
+            lua_pushvalue(l, -2);
+            lua_rawget(l, 1);
+            if (lua_rawequal(l, -1, -2)) {
+                lua_pop(l, 2);
+            }
+            else {
+                lua_pushvalue(l, -3);
+                lua_insert(l, -2);
+                lua_rawset(l, 2);
+                lua_pop(l, 1);
+            }
+        }
+
+        /* Bring back removed globals */
+        lua_pushnil(l);
+        while (lua_next(l, 1)) {
+            lua_pushvalue(l, -2);
+            lua_rawget(l, 2);
+            if (lua_isnil(l, -1)) {
+                lua_pop(l, 1);
+                lua_pushvalue(l, -2);
+                lua_insert(l, -2);
+                lua_rawset(l, 2);
+            }
+            else {
+                lua_pop(l, 2);
+            }
+        }
+
+        lua_settop(l, 0);
+    }
+
+private:
+    static inline const char snapshot_key = 0;
+
+    setup_t                              setup;
+    std::vector<std::unique_ptr<luactx>> states;
+    mutable std::mutex                   mtx;
+};
+
+} // namespace luacpp
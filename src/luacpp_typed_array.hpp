@@ -0,0 +1,306 @@
+#pragma once
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <utility>
+
+#include "luacpp_details.hpp"
+
+namespace luacpp
+{
+
+/* Description of a new typed_array (contiguous array of numbers owned by lua userdata)
+ * luapush creates the userdata and returns the std::span view of its elements.
+ * The initial values are copied at the push time, the elements are zero-initialized otherwise
+ */
+template <LuaTypedArrayElement T>
+struct typed_array {
+    using value_type = T;
+
+    explicit typed_array(size_t isize): size(isize) {}
+    explicit typed_array(std::span<const T> ivalues): size(ivalues.size()), values(ivalues.data()) {}
+
+    static constexpr size_t max_size = (std::numeric_limits<size_t>::max() - sizeof(typed_array_header)) / sizeof(T);
+
+    size_t   size;
+    const T* values = nullptr;
+};
+
+namespace details
+{
+    template <typename T>
+    T* _typed_array_data(typed_array_header* header) {
+        return reinterpret_cast<T*>(header + 1); // NOLINT
+    }
+
+    template <typename T>
+    typed_array_header* _typed_array_check(lua_State* l, int idx) {
+        auto header = _typed_array_header<T>(l, idx);
+        if (!header)
+            luaL_error(l, "typed_array<%s> expected, got %s", typed_array_traits<T>::name, luaL_typename(l, idx));
+        return header;
+    }
+
+    /* 1-based index check, raises the lua error on failure. NaN fails the range check */
+    inline size_t _typed_array_index(lua_State* l, typed_array_header* header, int idx) {
+        auto index = lua_tonumber(l, idx);
+        if (lua_type(l, idx) != LUA_TNUMBER || !(index >= 1 && index <= lua_Number(header->size)) ||
+            index - std::floor(index) > 0)
+            luaL_error(l, "typed_array index %s is out of range", lua_tostring(l, idx));
+        return size_t(index) - 1;
+    }
+
+    /* The integer elements are range-checked: NaN, infinities and the values out of the T range
+     * raise the lua error instead of the narrowing (the floats are truncated)
+     */
+    template <typename T>
+    T _typed_array_element(lua_State* l, int idx) {
+#if LUA_VERSION_NUM >= 503
+        if constexpr (std::is_integral_v<T>) {
+            if (lua_isinteger(l, idx)) {
+                auto value = lua_tointeger(l, idx);
+                if (!std::in_range<T>(value))
+                    luaL_error(l,
+                               "typed_array element %s is out of %s range",
+                               lua_tostring(l, idx),
+                               typed_array_traits<T>::name);
+                return T(value);
+            }
+        }
+#endif
+        if (lua_type(l, idx) != LUA_TNUMBER)
+            luaL_error(l, "typed_array element must be a number, got %s", luaL_typename(l, idx));
+
+        auto number = lua_tonumber(l, idx);
+        if constexpr (std::is_integral_v<T>) {
+            if (!(number > lua_Number(std::numeric_limits<T>::min()) - 1 &&
+                  number < lua_Number(std::numeric_limits<T>::max()) + 1))
+                luaL_error(l, "typed_array element %f is out of %s range", number, typed_array_traits<T>::name);
+        }
+        return T(number);
+    }
+
+    template <typename T>
+    int _typed_array_mt_index(lua_State* l) {
+        auto header = _typed_array_check<T>(l, 1);
+        if (lua_type(l, 2) != LUA_TNUMBER) {
+            lua_pushnil(l);
+            return 1;
+        }
+        luapush(l, _typed_array_data<T>(header)[_typed_array_index(l, header, 2)]);
+        return 1;
+    }
+
+    template <typename T>
+    int _typed_array_mt_newindex(lua_State* l) {
+        auto header = _typed_array_check<T>(l, 1);
+        auto index  = _typed_array_index(l, header, 2);
+        _typed_array_data<T>(header)[index] = _typed_array_element<T>(l, 3);
+        return 0;
+    }
+
+    template <typename T>
+    int _typed_array_mt_len(lua_State* l) {
+        lua_pushnumber(l, lua_Number(_typed_array_check<T>(l, 1)->size));
+        return 1;
+    }
+
+#ifdef WITH_LUAJIT
+    /* Element access through the FFI pointer, so the traces are not aborted on the C function calls.
+     * The userdata is casted to the pointer to its payload, elements start right after the header
+     */
+    inline constexpr auto _typed_array_ffi_metatable = R"(
+        local ctype, header_size, boxed, lower, upper = ...
+        local ffi = require("ffi")
+        local cast, tonumber, tostring, type, error = ffi.cast, tonumber, tostring, type, error
+        local ptr_t = ffi.typeof(ctype .. "*")
+        local size_ptr_t = ffi.typeof("uint64_t*")
+        local offset = header_size / ffi.sizeof(ctype) - 1
+
+        local function index_of(a, i)
+            if type(i) ~= "number" or i < 1 or i > tonumber(cast(size_ptr_t, a)[1]) or i % 1 ~= 0 then
+                error("typed_array index " .. tostring(i) .. " is out of range", 3)
+            end
+            return offset + i
+        end
+
+        local methods = {
+            ptr = function(a) return cast(ptr_t, a) + offset + 1 end,
+        }
+
+        local mt = {}
+        mt.__len = function(a) return tonumber(cast(size_ptr_t, a)[1]) end
+        if lower then
+            -- Integer elements: the same range check as in _typed_array_element, FFI would narrow the value
+            mt.__newindex = function(a, i, v)
+                if type(v) == "number" and not (v > lower and v < upper) then
+                    error("typed_array element " .. tostring(v) .. " is out of " .. ctype .. " range", 2)
+                end
+                cast(ptr_t, a)[index_of(a, i)] = v
+            end
+        else
+            mt.__newindex = function(a, i, v) cast(ptr_t, a)[index_of(a, i)] = v end
+        end
+        if boxed then
+            mt.__index = function(a, i)
+                if type(i) ~= "number" then return methods[i] end
+                return tonumber(cast(ptr_t, a)[index_of(a, i)])
+            end
+        else
+            mt.__index = function(a, i)
+                if type(i) ~= "number" then return methods[i] end
+                return cast(ptr_t, a)[index_of(a, i)]
+            end
+        end
+        return mt
+    )";
+
+    template <typename T>
+    bool _typed_array_push_ffi_metatable(lua_State* l) {
+        if (luaL_loadstring(l, _typed_array_ffi_metatable) != 0) {
+            lua_pop(l, 1);
+            return false;
+        }
+        lua_pushstring(l, typed_array_traits<T>::ctype);
+        lua_pushnumber(l, lua_Number(sizeof(typed_array_header)));
+        /* 64-bit integers are boxed into cdata by FFI */
+        lua_pushboolean(l, sizeof(T) == 8 && std::is_integral_v<T>);
+        if constexpr (std::is_integral_v<T>) {
+            lua_pushnumber(l, lua_Number(std::numeric_limits<T>::min()) - 1);
+            lua_pushnumber(l, lua_Number(std::numeric_limits<T>::max()) + 1);
+        }
+        else {
+            lua_pushnil(l);
+            lua_pushnil(l);
+        }
+        if (lua_pcall(l, 5, 1, 0) != 0) {
+            lua_pop(l, 1);
+            return false;
+        }
+        return true;
+    }
+#endif
+
+    /* The metatable is created once per state and element type and kept in the registry */
+    template <typename T>
+    void _typed_array_push_metatable(lua_State* l) {
+        static constexpr auto& key = typed_array_traits<T>::tag;
+
+        luaregistry_get(l, &key);
+        if (!lua_isnil(l, -1))
+            return;
+        lua_pop(l, 1);
+
+#ifdef WITH_LUAJIT
+        bool created = _typed_array_push_ffi_metatable<T>(l);
+#else
+        bool created = false;
+#endif
+        if (!created) {
+            lua_createtable(l, 0, 4);
+            lua_pushcfunction(l, &_typed_array_mt_index<T>);
+            lua_setfield(l, -2, "__index");
+            lua_pushcfunction(l, &_typed_array_mt_newindex<T>);
+            lua_setfield(l, -2, "__newindex");
+            lua_pushcfunction(l, &_typed_array_mt_len<T>);
+            lua_setfield(l, -2, "__len");
+        }
+
+        lua_pushfstring(l, "typed_array<%s>", typed_array_traits<T>::name);
+        lua_setfield(l, -2, "__name");
+
+        lua_pushvalue(l, -1);
+        luaregistry_set(l, &key);
+    }
+
+    /* typed_array.<name>(size) or typed_array.<name>(table) */
+    template <typename T>
+    int _typed_array_new(lua_State* l);
+
+    /* luapush from the lua_CFunction: the C++ exceptions are raised as the lua errors */
+    template <typename T>
+    std::span<T> _typed_array_push_new(lua_State* l, size_t size);
+} // namespace details
+
+template <LuaTypedArrayElement T>
+std::span<T> luapush(lua_State* l, const typed_array<T>& array) {
+    if (array.size > typed_array<T>::max_size)
+        throw std::length_error("luacpp: typed_array is too big");
+
+    auto header = static_cast<typed_array_header*>(
+        lua_newuserdata(l, sizeof(typed_array_header) + array.size * sizeof(T)));
+    header->tag  = typed_array_traits<T>::tag;
+    header->size = array.size;
+
+    auto data = details::_typed_array_data<T>(header);
+    if (array.size > 0) {
+        if (array.values)
+            std::memcpy(data, array.values, array.size * sizeof(T));
+        else
+            std::memset(data, 0, array.size * sizeof(T));
+    }
+
+    details::_typed_array_push_metatable<T>(l);
+    lua_setmetatable(l, -2);
+
+    return {data, array.size};
+}
+
+namespace details
+{
+    template <typename T>
+    std::span<T> _typed_array_push_new(lua_State* l, size_t size) {
+        std::span<T> data;
+        bool         failed = false;
+        try {
+            data = luapush(l, typed_array<T>(size));
+        } catch (const std::exception& e) {
+            _push_error_message(l, e.what());
+            failed = true;
+        }
+        if (failed)
+            lua_error(l);
+        return data;
+    }
+
+    template <typename T>
+    int _typed_array_new(lua_State* l) {
+        if (lua_type(l, 1) == LUA_TTABLE) {
+            auto size = size_t(lua_objlen(l, 1));
+            auto data = _typed_array_push_new<T>(l, size).data();
+            for (size_t i = 0; i < size; ++i) {
+                lua_rawgeti(l, 1, int(i + 1));
+                data[i] = _typed_array_element<T>(l, -1);
+                lua_pop(l, 1);
+            }
+            return 1;
+        }
+
+        auto size = luaL_checknumber(l, 1);
+        if (!(size >= 0 && size <= lua_Number(typed_array<T>::max_size)) || size - std::floor(size) > 0)
+            luaL_argerror(l, 1, "invalid typed_array size");
+
+        _typed_array_push_new<T>(l, size_t(size));
+        return 1;
+    }
+} // namespace details
+
+/* Global 'typed_array' table with the constructors: typed_array.float32(size_or_table), typed_array.int32(...), ... */
+inline void luaprovide_typed_arrays(lua_State* l) {
+    lua_createtable(l, 0, 5);
+    lua_pushcfunction(l, &details::_typed_array_new<float>);
+    lua_setfield(l, -2, typed_array_traits<float>::name);
+    lua_pushcfunction(l, &details::_typed_array_new<double>);
+    lua_setfield(l, -2, typed_array_traits<double>::name);
+    lua_pushcfunction(l, &details::_typed_array_new<int32_t>);
+    lua_setfield(l, -2, typed_array_traits<int32_t>::name);
+    lua_pushcfunction(l, &details::_typed_array_new<int64_t>);
+    lua_setfield(l, -2, typed_array_traits<int64_t>::name);
+    lua_pushcfunction(l, &details::_typed_array_new<uint8_t>);
+    lua_setfield(l, -2, typed_array_traits<uint8_t>::name);
+    lua_setglobal(l, "typed_array");
+}
+
+} // namespace luacpp
@@ -254,6 +254,85 @@ TEST_CASE("basic_types") {
         REQUIRE(top == l.top());
     }
 
+    SECTION("number arrays bulk conversion") {
+        auto l = luactx(lua_code{R"(
+            function reversed()
+                local t = {}
+                for i = 5, 1, -1 do t[i] = i * 0.5 end
+                return t
+            end
+            function extra_key() return {1, 2, 3, x = 4} end
+            function not_number() return {1, "two", 3} end
+            function hole() local t = {1, 2, 3, 4} t[2] = nil return t end
+            function sum(v) local s = 0 for i = 1, #v do s = s + v[i] end return s end
+            function test(v) return v end
+        )"});
+        auto top = l.top();
+
+        REQUIRE(l.extract<std::vector<double>()>(LUA_TNAME("reversed"))() ==
+                std::vector<double>{0.5, 1.0, 1.5, 2.0, 2.5});
+        REQUIRE(l.extract<std::array<double, 5>()>(LUA_TNAME("reversed"))() ==
+                std::array<double, 5>{0.5, 1.0, 1.5, 2.0, 2.5});
+
+        REQUIRE_THROWS_AS(l.extract<std::vector<int>()>(LUA_TNAME("extra_key"))(), errors::cast_error);
+        REQUIRE_THROWS_AS(l.extract<std::vector<int>()>(LUA_TNAME("not_number"))(), errors::cast_error);
+        REQUIRE_THROWS_AS(l.extract<std::vector<int>()>(LUA_TNAME("hole"))(), errors::cast_error);
+        REQUIRE_THROWS_AS((l.extract<std::array<int, 3>()>(LUA_TNAME("not_number"))()), errors::cast_error);
+        REQUIRE(top == l.top());
+
+        std::vector<double> big(100000);
+        for (size_t i = 0; i < big.size(); ++i) big[i] = double(i);
+        REQUIRE(l.extract<double(const std::vector<double>&)>(LUA_TNAME("sum"))(big) == 4999950000.0_a);
+        REQUIRE(l.extract<std::vector<double>(const std::vector<double>&)>(LUA_TNAME("test"))(big) == big);
+
+        l.provide(
+            LUA_TNAME("cppfunc"),
+            [](const std::vector<double>&) { return 1; },
+            [](const std::map<std::string, double>&) { return 2; });
+        l.load_and_call(lua_code{"r1 = cppfunc({1, 2}) r2 = cppfunc({a = 1})"});
+        REQUIRE(l.extract<int>(LUA_TNAME("r1")) == 1);
+        REQUIRE(l.extract<int>(LUA_TNAME("r2")) == 2);
+
+        REQUIRE(top == l.top());
+    }
+
+    SECTION("try_luaget") {
+        auto l = luactx(lua_code{R"(
+            numbers = {1, 2, 3}
+            strings = {"a", "b"}
+            nested = {{1, 2}, {3}}
+            dict = {a = 1, b = 2}
+            pair = {true, "str"}
+        )"});
+        auto state = l.state();
+        auto top   = l.top();
+
+        auto get = [&]<typename T>(const char* name) {
+            lua_getglobal(state, name);
+            auto result = try_luaget<T>(state, -1);
+            lua_pop(state, 1);
+            return result;
+        };
+
+        REQUIRE(get.operator()<std::vector<int>>("numbers") == std::vector{1, 2, 3});
+        REQUIRE(!get.operator()<std::vector<int>>("strings"));
+        REQUIRE(get.operator()<std::list<std::string>>("strings") == std::list<std::string>{"a", "b"});
+        REQUIRE(get.operator()<std::vector<std::vector<int>>>("nested") == std::vector<std::vector<int>>{{1, 2}, {3}});
+        REQUIRE(!get.operator()<std::vector<std::vector<std::string>>>("nested"));
+        REQUIRE(get.operator()<std::map<std::string, int>>("dict") == std::map<std::string, int>{{"a", 1}, {"b", 2}});
+        REQUIRE(!get.operator()<std::map<std::string, std::string>>("dict"));
+        REQUIRE(!get.operator()<std::vector<int>>("dict"));
+        REQUIRE(get.operator()<std::tuple<bool, std::string>>("pair") == std::tuple{true, std::string("str")});
+        REQUIRE(!get.operator()<std::tuple<bool, int>>("pair"));
+        REQUIRE(get.operator()<std::array<int, 3>>("numbers") == std::array{1, 2, 3});
+        REQUIRE(!get.operator()<std::array<int, 2>>("numbers"));
+        REQUIRE(get.operator()<std::optional<int>>("missing") == std::optional<int>{});
+        REQUIRE(!get.operator()<std::optional<int>>("strings"));
+        REQUIRE(!get.operator()<double>("strings"));
+
+        REQUIRE(top == l.top());
+    }
+
     SECTION("table <=> list<string>") {
         using vec = std::list<std::string>;
 
@@ -525,4 +604,36 @@ TEST_CASE("basic_types") {
         REQUIRE(!catched);
         REQUIRE(l.top() == top);
     }
+
+    SECTION("interned strings") {
+        auto l = luactx(lua_code{R"(
+            function same_string(a, b) return type(a) == "string" and a == b end
+            setmetatable(_G, {__index = function(_, key) return key .. "!" end})
+        )"});
+        auto top = l.top();
+
+        auto event = l.intern("on_update");
+        auto same  = l.extract<bool(const interned_string&, const std::string&)>(LUA_TNAME("same_string"));
+        REQUIRE(same(event, "on_update"));
+        REQUIRE(same(event, "on_update"));
+        l.release_interned(event);
+        REQUIRE(event.ref == LUA_NOREF);
+
+        /* The compile-time names are interned at the first push */
+        luaregistry_get(l.state(), LUA_TNAME("event_name")._storage);
+        REQUIRE(lua_isnil(l.state(), -1));
+        lua_pop(l.state(), 1);
+        REQUIRE(l.extract<bool(decltype(LUA_TNAME("event_name")), const std::string&)>(LUA_TNAME("same_string"))(
+            LUA_TNAME("event_name"), "event_name"));
+        luaregistry_get(l.state(), LUA_TNAME("event_name")._storage);
+        REQUIRE(l.get<std::string>(-1) == "event_name");
+        lua_pop(l.state(), 1);
+
+        /* Cached names keep the metamethods of the accessed tables */
+        REQUIRE(l.extract<std::string>(LUA_TNAME("missing")) == "missing!");
+        l.provide(LUA_TNAME("cached.name"), 1);
+        REQUIRE(l.extract<int>(LUA_TNAME("cached.name")) == 1);
+
+        REQUIRE(l.top() == top);
+    }
 }
@@ -1,7 +1,18 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/benchmark/catch_benchmark.hpp>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include "luacpp_basic.hpp"
+#include "simd4.hpp"
+#include "vector3.hpp"
 
 struct usertype1 {
     usertype1 operator+(double iv) const {
@@ -10,15 +21,102 @@ struct usertype1 {
     double v;
 };
 
+/* Same 4-double vectors, the kernels use aligned and unaligned loads respectively */
+struct alignas(32) aligned_vec4 {
+    aligned_vec4 operator+(const aligned_vec4& rhs) const {
+        aligned_vec4 result;
+        simd4::add_aligned(v, rhs.v, result.v);
+        return result;
+    }
+    double v[4];
+};
+
+struct unaligned_vec4 {
+    unaligned_vec4 operator+(const unaligned_vec4& rhs) const {
+        unaligned_vec4 result;
+        simd4::add_unaligned(v, rhs.v, result.v);
+        return result;
+    }
+    double v[4];
+};
+
+/* Large engine-like object, copying it on every callback is expensive */
+struct big_object {
+    double first() const {
+        return values.front();
+    }
+    std::array<double, 128> values;
+};
+
+/* vec3 described as the FFI struct, the values are cdata under LuaJIT */
+struct ffi_vec3 {
+    double dot(const ffi_vec3& v) const {
+        return x * v.x + y * v.y + z * v.z;
+    }
+
+    double x, y, z;
+};
+
+/* Large object with the internal storage, shared between C++ and lua */
+struct shared_object {
+    std::vector<double> values = std::vector<double>(128);
+};
+
 template <>
 struct luacpp::typespec_list_s<0> {
-    using type = std::tuple<typespec<usertype1, LUA_TNAME("usertype1")>>;
+    using type = std::tuple<typespec<usertype1, LUA_TNAME("usertype1")>,
+                            typespec<vector3<double>, LUA_TNAME("vec3")>,
+                            typespec<vector3<float>, LUA_TNAME("vec3_gc"), typespec_options{.gc = usertype_gc::force_gc}>,
+                            typespec<aligned_vec4, LUA_TNAME("aligned_vec4")>,
+                            typespec<unaligned_vec4, LUA_TNAME("unaligned_vec4")>,
+                            typespec<big_object, LUA_TNAME("big_object")>,
+                            typespec<shared_object, LUA_TNAME("shared_object")>,
+                            typespec<ffi_vec3, LUA_TNAME("ffi_vec3"), typespec_options{.ffi_struct = true}>>;
 };
 
 #include "luacpp_ctx.hpp"
+#include "luacpp_pool.hpp"
 
 using namespace luacpp;
 
+using vec3 = vector3<double>;
+
+void bench_setup_vec3(luactx& l) {
+    l.set_member_table(ordered_member_table<vec3>{lua_getsetez(x), lua_getsetez(y), lua_getsetez(z)});
+    l.provide(
+        LUA_TNAME("vec3.new"),
+        [] { return vec3(0); },
+        [](double v) { return vec3(v); },
+        [](double x, double y, double z) { return vec3(x, y, z); });
+    l.provide(LUA_TNAME("__add"), &vec3::operator+<double>);
+    l.provide(LUA_TNAME("__sub"), &vec3::operator-<double>);
+    l.provide_commutative_op(LUA_TNAME("__mul"), &vec3::operator*<double>);
+    l.provide(LUA_TNAME("__div"), &vec3::operator/<double>);
+    l.provide(LUA_TNAME("dot"), &vec3::dot<double>);
+    l.provide(LUA_TNAME("cross"), &vec3::cross<double>);
+}
+
+/* Every arithmetic operation produces a fresh vec3 userdata */
+constexpr auto vec3code = R"(
+function vec3_arith(N)
+    local acc = vec3.new(0)
+    local step = vec3.new(0.5, 0.25, 0.125)
+    for i = 1, N do
+        acc = acc + step * 2 - step / 2
+    end
+    return acc.x + acc.y + acc.z
+end
+
+function vec3_tables(N)
+    local sum = 0
+    for i = 1, N do
+        local t = {x = i, y = i, z = i}
+        sum = sum + t.x + t.y + t.z
+    end
+    return sum
+end
+)";
+
 constexpr auto luacode = R"(
 function no_ret_no_arg() end
 
@@ -38,6 +136,10 @@ function lua_three_arg(a, b, c)
     return cpp_three_arg(a, b, c)
 end
 
+function lua_three_arg_static(a, b, c)
+    return cpp_three_arg_static(a, b, c)
+end
+
 function overloaded1()
     return cpp_overloaded()
 end
@@ -236,6 +338,29 @@ TEST_CASE("bidirectional_call") {
     };
 }
 
+TEST_CASE("function_storage") {
+    auto l = luactx(lua_code{luacode});
+
+    /* Legacy path: the callable is kept in the static func_storage singleton */
+    constexpr auto static_name = LUA_TNAME("cpp_three_arg_static");
+    luaprovide(static_name,
+               l.state(),
+               wrap_function<static_name.hash()>([](double a, double b, double c) { return a + b + c; }));
+    auto lua_three_arg_static = l.extract<double(double, double, double)>(LUA_TNAME("lua_three_arg_static"));
+
+    /* Closure path: the callable is the upvalue of the pushed C closure */
+    l.provide(LUA_TNAME("cpp_three_arg"), [](double a, double b, double c) { return a + b + c; });
+    auto lua_three_arg = l.extract<double(double, double, double)>(LUA_TNAME("lua_three_arg"));
+
+    BENCHMARK("static func_storage") {
+        return lua_three_arg_static(1.2, 3.3, 4.4);
+    };
+
+    BENCHMARK("closure upvalue storage") {
+        return lua_three_arg(1.2, 3.3, 4.4);
+    };
+}
+
 TEST_CASE("bidirectional_overloaded_call") {
     auto l           = luactx(lua_code{luacode});
     auto overloaded1 = l.extract<double()>(LUA_TNAME("overloaded1"));
@@ -300,3 +425,794 @@ TEST_CASE("nbody") {
         return f(100000);
     };
 }
+
+TEST_CASE("pooled_allocator") {
+    auto default_nbody = luactx(lua_code{nbody});
+    auto pooled_nbody  = luactx(pooled_allocator);
+    pooled_nbody.load_and_call(lua_code{nbody});
+
+    auto f1 = default_nbody.extract<std::pair<double, double>(double)>(LUA_TNAME("nbody_run"));
+    auto f2 = pooled_nbody.extract<std::pair<double, double>(double)>(LUA_TNAME("nbody_run"));
+
+    BENCHMARK("nbody (N == 100000, system allocator)") {
+        return f1(100000);
+    };
+    BENCHMARK("nbody (N == 100000, pooled allocator)") {
+        return f2(100000);
+    };
+
+    auto default_vec3 = luactx(lua_code{vec3code});
+    auto pooled_vec3  = luactx(pooled_allocator);
+    pooled_vec3.load_and_call(lua_code{vec3code});
+    bench_setup_vec3(default_vec3);
+    bench_setup_vec3(pooled_vec3);
+
+    auto vec1 = default_vec3.extract<double(int)>(LUA_TNAME("vec3_arith"));
+    auto vec2 = pooled_vec3.extract<double(int)>(LUA_TNAME("vec3_arith"));
+    auto tbl1 = default_vec3.extract<double(int)>(LUA_TNAME("vec3_tables"));
+    auto tbl2 = pooled_vec3.extract<double(int)>(LUA_TNAME("vec3_tables"));
+
+    BENCHMARK("vec3 arithmetic (N == 10000, system allocator)") {
+        return vec1(10000);
+    };
+    BENCHMARK("vec3 arithmetic (N == 10000, pooled allocator)") {
+        return vec2(10000);
+    };
+    BENCHMARK("small tables (N == 10000, system allocator)") {
+        return tbl1(10000);
+    };
+    BENCHMARK("small tables (N == 10000, pooled allocator)") {
+        return tbl2(10000);
+    };
+}
+
+TEST_CASE("luactx_pool") {
+    auto setup = [](luactx& l) {
+        l.load_and_call(lua_code{luacode});
+        l.load_and_call(lua_code{vec3code});
+        l.provide(LUA_TNAME("cpp_three_arg"), [](double a, double b, double c) { return a + b + c; });
+        bench_setup_vec3(l);
+    };
+    auto pool = luactx_pool(4, setup);
+
+    BENCHMARK("construct new luactx") {
+        luactx l;
+        setup(l);
+        return l.top();
+    };
+
+    BENCHMARK("checkout + reset") {
+        auto lease = pool.checkout();
+        return lease->top();
+    };
+
+    BENCHMARK("checkout + call + reset") {
+        auto lease = pool.checkout();
+        return lease->extract<double(int)>(LUA_TNAME("vec3_arith"))(10);
+    };
+}
+
+namespace {
+/* Script bundle with lots of functions, so the compilation cost dominates */
+std::string generate_functions_script(int count) {
+    std::string code;
+    for (int i = 0; i < count; ++i) {
+        auto n = std::to_string(i);
+        code += "function f" + n + "(a, b)\n"
+                "    local t = {a = a, b = b, n = " + n + "}\n"
+                "    for i = 1, 10 do t.a = t.a + i * t.b end\n"
+                "    if t.a > t.b then return t.a - t.b else return t.b - t.a end\n"
+                "end\n";
+    }
+    return code;
+}
+
+std::filesystem::path write_bench_file(const std::string& name, const std::string& content) {
+    auto dir = std::filesystem::temp_directory_path() / "luacpp_benchmarks";
+    std::filesystem::create_directories(dir);
+    auto path = dir / name;
+    auto file = std::ofstream(path, std::ios::binary | std::ios::trunc);
+    file.write(content.data(), std::streamsize(content.size()));
+    return path;
+}
+} // namespace
+
+TEST_CASE("bytecode_cache") {
+    auto script    = write_bench_file("functions.lua", generate_functions_script(5000)).string();
+    auto cache_dir = std::filesystem::temp_directory_path() / "luacpp_benchmarks" / "cache";
+    luactx l;
+
+    BENCHMARK("load from source") {
+        l.load(script.data());
+        lua_pop(l.state(), 1);
+    };
+
+    l.enable_bytecode_cache(cache_dir);
+    l.load(script.data());
+    lua_pop(l.state(), 1);
+
+    BENCHMARK("load from warm bytecode cache") {
+        l.load(script.data());
+        lua_pop(l.state(), 1);
+    };
+}
+
+namespace {
+/* Generated data script: one big table constructor */
+std::string generate_table_script(int count) {
+    std::string code = "data = {\n";
+    for (int i = 0; i < count; ++i) {
+        auto n = std::to_string(i);
+        code += "    {id = " + n + ", name = \"item" + n + "\", weight = " + n + ".5, tags = {\"a\", \"b\"}},\n";
+    }
+    code += "}\n";
+    return code;
+}
+} // namespace
+
+TEST_CASE("load_mapped") {
+    auto code   = generate_table_script(100000);
+    auto script = write_bench_file("table.lua", code).string();
+    luactx l;
+
+    BENCHMARK("load(lua_code)") {
+        l.load(lua_code{code});
+        lua_pop(l.state(), 1);
+    };
+
+    BENCHMARK("load(path)") {
+        l.load(script.data());
+        lua_pop(l.state(), 1);
+    };
+
+    BENCHMARK("load_mapped(path)") {
+        l.load_mapped(script.data());
+        lua_pop(l.state(), 1);
+    };
+}
+
+/* Per-iteration time of 100k elements conversion, elements/sec = 1e5 / mean */
+TEST_CASE("number_arrays") {
+    constexpr size_t count = 100000;
+
+    auto l = luactx(lua_code{"function identity(v) return v end"});
+
+    std::vector<double> vd(count);
+    std::vector<int>    vi(count);
+    for (size_t i = 0; i < count; ++i) {
+        vd[i] = double(i) * 0.5;
+        vi[i] = int(i);
+    }
+    auto arr = std::make_unique<std::array<float, count>>();
+    for (size_t i = 0; i < count; ++i) (*arr)[i] = float(i);
+
+    auto state = l.state();
+
+    BENCHMARK("push vector<double> x100k") {
+        luapush(state, vd);
+        lua_pop(state, 1);
+    };
+    BENCHMARK("push vector<int> x100k") {
+        luapush(state, vi);
+        lua_pop(state, 1);
+    };
+    BENCHMARK("push array<float, 100k>") {
+        luapush(state, *arr);
+        lua_pop(state, 1);
+    };
+
+    luapush(state, vd);
+    BENCHMARK("get vector<double> x100k") {
+        return luaget<std::vector<double>>(state, -1);
+    };
+    lua_pop(state, 1);
+
+    luapush(state, vi);
+    BENCHMARK("get vector<int> x100k") {
+        return luaget<std::vector<int>>(state, -1);
+    };
+    lua_pop(state, 1);
+
+    luapush(state, *arr);
+    BENCHMARK("get array<float, 100k>") {
+        return luaget<std::array<float, count>>(state, -1).size();
+    };
+    lua_pop(state, 1);
+
+    auto identity = l.extract<std::vector<double>(const std::vector<double>&)>(LUA_TNAME("identity"));
+    BENCHMARK("round trip vector<double> x100k") {
+        return identity(vd);
+    };
+}
+
+TEST_CASE("overloaded_tables") {
+    auto l = luactx(lua_code{R"(
+        local numbers, strings, dict = {}, {}, {}
+        for i = 1, 10000 do
+            numbers[i] = i * 0.5
+            strings[i] = tostring(i)
+            dict["k" .. i] = i
+        end
+        function call_numbers() return cpp_overloaded(numbers) end
+        function call_strings() return cpp_overloaded(strings) end
+        function call_dict() return cpp_overloaded(dict) end
+    )"});
+
+    l.provide(
+        LUA_TNAME("cpp_overloaded"),
+        [](const std::map<std::string, double>& v) { return double(v.size()); },
+        [](const std::vector<std::string>& v) { return double(v.size()); },
+        [](const std::vector<double>& v) { return v.back(); });
+
+    auto call_numbers = l.extract<double()>(LUA_TNAME("call_numbers"));
+    auto call_strings = l.extract<double()>(LUA_TNAME("call_strings"));
+    auto call_dict    = l.extract<double()>(LUA_TNAME("call_dict"));
+
+    BENCHMARK("vector<double> x10k (third overload)") {
+        return call_numbers();
+    };
+    BENCHMARK("vector<string> x10k (second overload)") {
+        return call_strings();
+    };
+    BENCHMARK("map<string, double> x10k (first overload)") {
+        return call_dict();
+    };
+}
+
+TEST_CASE("typed_array") {
+    auto l = luactx(lua_code{R"(
+        function sum(a)
+            local s = 0
+            for i = 1, #a do s = s + a[i] end
+            return s
+        end
+        table_values = {}
+        for i = 1, 100000 do table_values[i] = i * 0.5 end
+        function sum_table() return sum(table_values) end
+        function sum_typed() return sum(typed_values) end
+        function cpp_sum_table() return cpp_sum_vector(table_values) end
+        function cpp_sum_typed() return cpp_sum_span(typed_values) end
+    )"});
+    l.provide_typed_arrays();
+
+    auto data = l.provide(LUA_TNAME("typed_values"), typed_array<double>(100000));
+    for (size_t i = 0; i < data.size(); ++i) data[i] = double(i + 1) * 0.5;
+
+    l.provide(LUA_TNAME("cpp_sum_vector"), [](const std::vector<double>& v) {
+        return std::accumulate(v.begin(), v.end(), 0.0);
+    });
+    l.provide(LUA_TNAME("cpp_sum_span"), [](std::span<const double> v) {
+        return std::accumulate(v.begin(), v.end(), 0.0);
+    });
+
+    auto sum_table     = l.extract<double()>(LUA_TNAME("sum_table"));
+    auto sum_typed     = l.extract<double()>(LUA_TNAME("sum_typed"));
+    auto cpp_sum_table = l.extract<double()>(LUA_TNAME("cpp_sum_table"));
+    auto cpp_sum_typed = l.extract<double()>(LUA_TNAME("cpp_sum_typed"));
+
+    BENCHMARK("c++ sum of table x100k") {
+        return cpp_sum_table();
+    };
+    BENCHMARK("c++ sum of typed_array x100k") {
+        return cpp_sum_typed();
+    };
+    BENCHMARK("lua sum of table x100k") {
+        return sum_table();
+    };
+    BENCHMARK("lua sum of typed_array x100k") {
+        return sum_typed();
+    };
+}
+
+TEST_CASE("usertype_push") {
+    auto l = luactx(lua_code{vec3code});
+    bench_setup_vec3(l);
+
+    auto arith = l.extract<double(int)>(LUA_TNAME("vec3_arith"));
+    auto state = l.state();
+
+    BENCHMARK("vec3 arithmetic (N == 10000)") {
+        return arith(10000);
+    };
+    BENCHMARK("push vec3 x10000") {
+        for (int i = 0; i < 10000; ++i) {
+            luapush(state, vec3(double(i)));
+            lua_pop(state, 1);
+        }
+        return lua_gettop(state);
+    };
+}
+
+TEST_CASE("member_tables") {
+    constexpr auto fields_code = R"(
+        function fields(N)
+            local v = vec3.new(1, 2, 3)
+            local sum = 0
+            for i = 1, N do
+                v.x = v.y + i
+                sum = sum + v.x + v.y + v.z
+            end
+            return sum
+        end
+    )";
+
+    auto map_ctx      = luactx(lua_code{fields_code});
+    auto ordered_ctx  = luactx(lua_code{fields_code});
+    auto interned_ctx = luactx(lua_code{fields_code});
+    bench_setup_vec3(map_ctx);
+    bench_setup_vec3(ordered_ctx);
+    bench_setup_vec3(interned_ctx);
+
+    map_ctx.set_member_table(member_table<vec3>{lua_getsetez(x), lua_getsetez(y), lua_getsetez(z)});
+    interned_ctx.set_member_table(interned_member_table<vec3>{lua_getsetez(x), lua_getsetez(y), lua_getsetez(z)});
+
+    auto map_fields      = map_ctx.extract<double(int)>(LUA_TNAME("fields"));
+    auto ordered_fields  = ordered_ctx.extract<double(int)>(LUA_TNAME("fields"));
+    auto interned_fields = interned_ctx.extract<double(int)>(LUA_TNAME("fields"));
+
+    BENCHMARK("member_table (N == 10000)") {
+        return map_fields(10000);
+    };
+    BENCHMARK("ordered_member_table (N == 10000)") {
+        return ordered_fields(10000);
+    };
+    BENCHMARK("interned_member_table (N == 10000)") {
+        return interned_fields(10000);
+    };
+}
+
+TEST_CASE("methods_first") {
+    constexpr auto methods_code = R"(
+        function methods(N)
+            local a = vec3.new(1, 2, 3)
+            local b = vec3.new(0.5, 0.25, 0.125)
+            local sum = 0
+            for i = 1, N do
+                sum = sum + a:dot(b) + a:cross(b):dot(a) + a.x
+            end
+            return sum
+        end
+    )";
+
+    auto fields_first_ctx  = luactx(lua_code{methods_code});
+    auto methods_first_ctx = luactx(lua_code{methods_code});
+    bench_setup_vec3(fields_first_ctx);
+    bench_setup_vec3(methods_first_ctx);
+    methods_first_ctx.set_member_table(ordered_member_table<vec3>{lua_getsetez(x), lua_getsetez(y), lua_getsetez(z)},
+                                       member_lookup::methods_first);
+
+    auto fields_first  = fields_first_ctx.extract<double(int)>(LUA_TNAME("methods"));
+    auto methods_first = methods_first_ctx.extract<double(int)>(LUA_TNAME("methods"));
+
+    BENCHMARK("vec3 method calls, fields first (N == 10000)") {
+        return fields_first(10000);
+    };
+    BENCHMARK("vec3 method calls, methods first (N == 10000)") {
+        return methods_first(10000);
+    };
+}
+
+TEST_CASE("usertype_gc") {
+    constexpr auto temporaries_code = R"(
+        function temporaries(ctor, N)
+            local step = ctor(1)
+            local acc = ctor(0)
+            for i = 1, N do
+                acc = step + step
+            end
+            return acc.x
+        end
+        function no_finalizers(N) return temporaries(vec3.new, N) end
+        function finalizers(N) return temporaries(vec3_gc.new, N) end
+    )";
+
+    auto l = luactx(lua_code{temporaries_code});
+    l.set_member_table(ordered_member_table<vector3<double>>{lua_getez(x)});
+    l.set_member_table(ordered_member_table<vector3<float>>{lua_getez(x)});
+    l.provide(LUA_TNAME("vec3.new"), [](double v) { return vector3<double>(v); });
+    l.provide(LUA_TNAME("vec3_gc.new"), [](float v) { return vector3<float>(v); });
+    l.provide(LUA_TNAME("__add"), &vector3<double>::operator+<double>);
+    l.provide(LUA_TNAME("__add"), &vector3<float>::operator+<float>);
+
+    auto no_finalizers = l.extract<double(int)>(LUA_TNAME("no_finalizers"));
+    auto finalizers    = l.extract<double(int)>(LUA_TNAME("finalizers"));
+
+    BENCHMARK("trivially destructible, no __gc (N == 1000000)") {
+        return no_finalizers(1000000);
+    };
+    BENCHMARK("forced __gc (N == 1000000)") {
+        return finalizers(1000000);
+    };
+}
+
+TEST_CASE("aligned_usertypes") {
+    constexpr auto kernels_code = R"(
+        function accumulate(ctor, N)
+            local acc = ctor(0)
+            local step = ctor(1)
+            for i = 1, N do acc = acc + step end
+            return acc
+        end
+        function aligned(N) accumulate(aligned_vec4.new, N) end
+        function unaligned(N) accumulate(unaligned_vec4.new, N) end
+    )";
+
+    auto l = luactx(lua_code{kernels_code});
+    l.provide(LUA_TNAME("aligned_vec4.new"), [](double v) { return aligned_vec4{{v, v, v, v}}; });
+    l.provide(LUA_TNAME("unaligned_vec4.new"), [](double v) { return unaligned_vec4{{v, v, v, v}}; });
+    l.provide(LUA_TNAME("__add"), &aligned_vec4::operator+);
+    l.provide(LUA_TNAME("__add"), &unaligned_vec4::operator+);
+
+    auto aligned   = l.extract<void(int)>(LUA_TNAME("aligned"));
+    auto unaligned = l.extract<void(int)>(LUA_TNAME("unaligned"));
+
+    BENCHMARK("alignas(32) payload, aligned loads (N == 100000)") {
+        aligned(100000);
+    };
+    BENCHMARK("alignof 8 payload, unaligned loads (N == 100000)") {
+        unaligned(100000);
+    };
+}
+
+TEST_CASE("borrowed_usertypes") {
+    auto l = luactx(lua_code{"function on_event(obj) return obj:first() end"});
+    l.provide(LUA_TNAME("first"), &big_object::first);
+
+    auto object   = big_object{};
+    auto copied   = l.extract<double(const big_object&)>(LUA_TNAME("on_event"));
+    auto borrowed = l.extract<double(luacpp::borrowed<big_object>)>(LUA_TNAME("on_event"));
+
+    static_assert(sizeof(big_object) == 1024);
+
+    BENCHMARK("callback with 1 KiB object, copy") {
+        return copied(object);
+    };
+    BENCHMARK("callback with 1 KiB object, borrowed") {
+        return borrowed(borrow(object));
+    };
+}
+
+TEST_CASE("shared_usertypes") {
+    auto l     = luactx();
+    auto state = l.state();
+
+    auto value  = shared_object{};
+    auto shared = std::make_shared<shared_object>();
+
+    BENCHMARK("push shared_object by value") {
+        luapush(state, value);
+        lua_pop(state, 1);
+    };
+    BENCHMARK("push std::shared_ptr<shared_object>") {
+        luapush(state, shared);
+        lua_pop(state, 1);
+    };
+
+    luapush(state, value);
+    BENCHMARK("get shared_object& (value)") {
+        return luaget<shared_object&>(state, -1).values.size();
+    };
+    lua_pop(state, 1);
+
+    luapush(state, shared);
+    BENCHMARK("get shared_object& (shared_ptr)") {
+        return luaget<shared_object&>(state, -1).values.size();
+    };
+    BENCHMARK("get std::shared_ptr<shared_object>") {
+        return luaget<std::shared_ptr<shared_object>>(state, -1).use_count();
+    };
+    lua_pop(state, 1);
+}
+
+TEST_CASE("identity_cache") {
+    constexpr auto callback_code = "function on_frame(entity) return entity:first() end";
+
+    auto uncached_ctx = luactx(lua_code{callback_code});
+    auto cached_ctx   = luactx(lua_code{callback_code});
+    uncached_ctx.provide(LUA_TNAME("first"), &big_object::first);
+    cached_ctx.provide(LUA_TNAME("first"), &big_object::first);
+    cached_ctx.enable_identity_cache();
+
+    auto entity   = big_object{};
+    auto uncached = uncached_ctx.extract<double(luacpp::borrowed<big_object>)>(LUA_TNAME("on_frame"));
+    auto cached   = cached_ctx.extract<double(luacpp::borrowed<big_object>)>(LUA_TNAME("on_frame"));
+
+    BENCHMARK("callback with the same borrowed entity, no cache") {
+        return uncached(borrow(entity));
+    };
+    BENCHMARK("callback with the same borrowed entity, identity cache") {
+        return cached(borrow(entity));
+    };
+}
+
+TEST_CASE("multiple_returns") {
+    auto l = luactx(lua_code{R"(
+        function call_tuple(N)
+            local sum = 0
+            for i = 1, N do
+                local t = divmod_tuple(i, 7)
+                sum = sum + t[1] + t[2]
+            end
+            return sum
+        end
+        function call_multiresult(N)
+            local sum = 0
+            for i = 1, N do
+                local q, r = divmod_multiresult(i, 7)
+                sum = sum + q + r
+            end
+            return sum
+        end
+    )"});
+    l.provide(LUA_TNAME("divmod_tuple"), [](int a, int b) { return std::tuple{a / b, a % b}; });
+    l.provide(LUA_TNAME("divmod_multiresult"), [](int a, int b) { return multiresult{a / b, a % b}; });
+
+    auto call_tuple       = l.extract<double(int)>(LUA_TNAME("call_tuple"));
+    auto call_multiresult = l.extract<double(int)>(LUA_TNAME("call_multiresult"));
+
+    BENCHMARK("std::tuple return as table (N == 10000)") {
+        return call_tuple(10000);
+    };
+    BENCHMARK("multiresult return (N == 10000)") {
+        return call_multiresult(10000);
+    };
+}
+
+TEST_CASE("string_arguments") {
+    auto l = luactx(lua_code{R"(
+        local keys = {}
+        for i = 1, 64 do keys[i] = "configuration.section.value_" .. i end
+        function lookup_all(N, lookup)
+            local sum = 0
+            for i = 1, N do
+                sum = sum + lookup(keys[i % 64 + 1])
+            end
+            return sum
+        end
+        function lookup_string(N) return lookup_all(N, lookup_by_string) end
+        function lookup_view(N) return lookup_all(N, lookup_by_view) end
+        function lookup_cstr(N) return lookup_all(N, lookup_by_cstr) end
+    )"});
+
+    std::map<std::string, int, std::less<>> values;
+    for (int i = 1; i <= 64; ++i)
+        values.emplace("configuration.section.value_" + std::to_string(i), i);
+
+    l.provide(LUA_TNAME("lookup_by_string"), [&](const std::string& key) { return values.find(key)->second; });
+    l.provide(LUA_TNAME("lookup_by_view"), [&](std::string_view key) { return values.find(key)->second; });
+    l.provide(LUA_TNAME("lookup_by_cstr"), [&](const char* key) { return values.find(std::string_view(key))->second; });
+
+    auto lookup_string = l.extract<double(int)>(LUA_TNAME("lookup_string"));
+    auto lookup_view   = l.extract<double(int)>(LUA_TNAME("lookup_view"));
+    auto lookup_cstr   = l.extract<double(int)>(LUA_TNAME("lookup_cstr"));
+
+    BENCHMARK("std::string key argument (N == 10000)") {
+        return lookup_string(10000);
+    };
+    BENCHMARK("std::string_view key argument (N == 10000)") {
+        return lookup_view(10000);
+    };
+    BENCHMARK("const char* key argument (N == 10000)") {
+        return lookup_cstr(10000);
+    };
+}
+
+TEST_CASE("string_cache") {
+    auto l = luactx(lua_code{"config = {graphics = {resolution_width = 1920}}"});
+    auto s = l.state();
+    lua_checkstack(s, 1000);
+
+    auto event = l.intern("on_entity_position_changed");
+
+    BENCHMARK("lua_pushstring (1000 times)") {
+        for (int i = 0; i < 1000; ++i)
+            lua_pushstring(s, "on_entity_position_changed");
+        lua_pop(s, 1000);
+    };
+    BENCHMARK("push compile-time name (1000 times)") {
+        for (int i = 0; i < 1000; ++i)
+            luapush(s, LUA_TNAME("on_entity_position_changed"));
+        lua_pop(s, 1000);
+    };
+    BENCHMARK("push interned string (1000 times)") {
+        for (int i = 0; i < 1000; ++i)
+            luapush(s, event);
+        lua_pop(s, 1000);
+    };
+
+    BENCHMARK("extract with runtime name") {
+        return l.extract<int>(lua_name("config.graphics.resolution_width"));
+    };
+    BENCHMARK("extract with compile-time name") {
+        return l.extract<int>(LUA_TNAME("config.graphics.resolution_width"));
+    };
+}
+
+TEST_CASE("ffi_functions") {
+    auto l = luactx(lua_code{R"(
+        function hot_loop(f, N)
+            local s = 0
+            for i = 1, N do
+                s = f(s, 0.5, i)
+            end
+            return s
+        end
+        function call_closure(N) return hot_loop(mad_closure, N) end
+        function call_ffi(N) return hot_loop(mad_ffi, N) end
+    )"});
+
+    auto mad = [](double a, double b, double c) noexcept { return a * b + c; };
+    l.provide(LUA_TNAME("mad_closure"), mad);
+    l.provide_ffi(LUA_TNAME("mad_ffi"), mad);
+
+    auto call_closure = l.extract<double(int)>(LUA_TNAME("call_closure"));
+    auto call_ffi     = l.extract<double(int)>(LUA_TNAME("call_ffi"));
+
+    BENCHMARK("three doubles through lua_CFunction (N == 100000)") {
+        return call_closure(100000);
+    };
+    BENCHMARK("three doubles through FFI (N == 100000)") {
+        return call_ffi(100000);
+    };
+}
+
+/* Same arithmetic as vec3code, the metamethods are lua functions over the cdata fields */
+constexpr auto ffi_vec3code = R"(
+local new = ffi_vec3.ctype
+ffi_vec3.__add = function(a, b) return new(a.x + b.x, a.y + b.y, a.z + b.z) end
+ffi_vec3.__sub = function(a, b) return new(a.x - b.x, a.y - b.y, a.z - b.z) end
+ffi_vec3.__mul = function(a, k) return new(a.x * k, a.y * k, a.z * k) end
+ffi_vec3.__div = function(a, k) return new(a.x / k, a.y / k, a.z / k) end
+
+function vec3_arith(N)
+    local acc = new(0, 0, 0)
+    local step = new(0.5, 0.25, 0.125)
+    for i = 1, N do
+        acc = acc + step * 2 - step / 2
+    end
+    return acc:dot(new(1, 1, 1))
+end
+)";
+
+TEST_CASE("ffi_struct_usertypes") {
+    auto userdata = luactx(lua_code{vec3code});
+    bench_setup_vec3(userdata);
+
+    luactx cdata;
+    cdata.provide(LUA_TNAME("dot"), &ffi_vec3::dot);
+    bool enabled = cdata.set_ffi_struct<ffi_vec3>(
+        {ffi_field("x", &ffi_vec3::x), ffi_field("y", &ffi_vec3::y), ffi_field("z", &ffi_vec3::z)});
+    /* LuaJIT FFI is not available */
+    if (!enabled)
+        return;
+    cdata.load_and_call(lua_code{ffi_vec3code});
+
+    auto arith_userdata = userdata.extract<double(int)>(LUA_TNAME("vec3_arith"));
+    auto arith_cdata    = cdata.extract<double(int)>(LUA_TNAME("vec3_arith"));
+
+    BENCHMARK("vec3 arithmetic, userdata (N == 10000)") {
+        return arith_userdata(10000);
+    };
+    BENCHMARK("vec3 arithmetic, FFI cdata (N == 10000)") {
+        return arith_cdata(10000);
+    };
+}
+
+TEST_CASE("unchecked_bindings") {
+    auto l = luactx(lua_code{R"(
+        function hot_loop(f, N)
+            local s = 0
+            for i = 1, N do
+                s = f(s, 0.5, i)
+            end
+            return s
+        end
+        function vec_loop(f, v, N)
+            local s = 0
+            for i = 1, N do
+                s = s + f(v)
+            end
+            return s
+        end
+        function call_checked(N) return hot_loop(mad_checked, N) end
+        function call_unchecked(N) return hot_loop(mad_unchecked, N) end
+        function vec_checked(N) return vec_loop(vec_sum_checked, vec3.new(1, 2, 3), N) end
+        function vec_unchecked(N) return vec_loop(vec_sum_unchecked, vec3.new(1, 2, 3), N) end
+    )"});
+    bench_setup_vec3(l);
+
+    auto mad     = [](double a, double b, double c) { return a * b + c; };
+    auto vec_sum = [](const vec3& v) { return v.x + v.y + v.z; };
+    l.provide(LUA_TNAME("mad_checked"), mad);
+    l.provide_unchecked(LUA_TNAME("mad_unchecked"), mad);
+    l.provide(LUA_TNAME("vec_sum_checked"), vec_sum);
+    l.provide_unchecked(LUA_TNAME("vec_sum_unchecked"), vec_sum);
+
+    auto call_checked   = l.extract<double(int)>(LUA_TNAME("call_checked"));
+    auto call_unchecked = l.extract<double(int)>(LUA_TNAME("call_unchecked"));
+    auto vec_checked    = l.extract<double(int)>(LUA_TNAME("vec_checked"));
+    auto vec_unchecked  = l.extract<double(int)>(LUA_TNAME("vec_unchecked"));
+
+    BENCHMARK("three doubles, checked (N == 100000)") {
+        return call_checked(100000);
+    };
+    BENCHMARK("three doubles, unchecked (N == 100000)") {
+        return call_unchecked(100000);
+    };
+    BENCHMARK("usertype argument, checked (N == 100000)") {
+        return vec_checked(100000);
+    };
+    BENCHMARK("usertype argument, unchecked (N == 100000)") {
+        return vec_unchecked(100000);
+    };
+}
+
+TEST_CASE("integer_float_overloads") {
+    auto l = luactx(lua_code{R"(
+        function mixed_loop(f, N)
+            local s = 0
+            for i = 1, N do
+                s = s + f(i) + f(i + 0.5)
+            end
+            return s
+        end
+        function call_single(N) return mixed_loop(num_single, N) end
+        function call_overloaded(N) return mixed_loop(num_overloaded, N) end
+        function call_overloaded_reversed(N) return mixed_loop(num_overloaded_reversed, N) end
+    )"});
+
+    l.provide(LUA_TNAME("num_single"), [](double v) { return v; });
+    l.provide(
+        LUA_TNAME("num_overloaded"), [](int64_t v) { return double(v); }, [](double v) { return v * 2.0; });
+    l.provide(
+        LUA_TNAME("num_overloaded_reversed"), [](double v) { return v * 2.0; }, [](int64_t v) { return double(v); });
+
+    auto call_single              = l.extract<double(int)>(LUA_TNAME("call_single"));
+    auto call_overloaded          = l.extract<double(int)>(LUA_TNAME("call_overloaded"));
+    auto call_overloaded_reversed = l.extract<double(int)>(LUA_TNAME("call_overloaded_reversed"));
+
+    BENCHMARK("mixed integer/float calls, single double binding (N == 100000)") {
+        return call_single(100000);
+    };
+    BENCHMARK("mixed integer/float calls, int64_t/double overloads (N == 100000)") {
+        return call_overloaded(100000);
+    };
+    BENCHMARK("mixed integer/float calls, double/int64_t overloads (N == 100000)") {
+        return call_overloaded_reversed(100000);
+    };
+}
+
+TEST_CASE("result_bindings") {
+    auto l = luactx(lua_code{R"(
+        function hot_loop(f, N)
+            local s = 0
+            for i = 1, N do
+                s = s + f(i, 3)
+            end
+            return s
+        end
+        function call_regular(N) return hot_loop(div_regular, N) end
+        function call_result(N) return hot_loop(div_result, N) end
+    )"});
+
+    l.provide(LUA_TNAME("div_regular"), [](int a, int b) {
+        if (b == 0)
+            throw std::runtime_error("division by zero");
+        return a / b;
+    });
+    l.provide(LUA_TNAME("div_result"), [](int a, int b) noexcept -> result<int> {
+        if (b == 0)
+            return result_error{"division by zero"};
+        return a / b;
+    });
+
+    auto call_regular = l.extract<double(int)>(LUA_TNAME("call_regular"));
+    auto call_result  = l.extract<double(int)>(LUA_TNAME("call_result"));
+
+    BENCHMARK("success path, try/catch wrapper (N == 100000)") {
+        return call_regular(100000);
+    };
+    BENCHMARK("success path, result<int> (N == 100000)") {
+        return call_result(100000);
+    };
+}
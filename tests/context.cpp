@@ -0,0 +1,173 @@
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fstream>
+
+#include "lua.hpp"
+#include "luacpp_pool.hpp"
+
+using namespace luacpp;
+
+TEST_CASE("luactx_pool") {
+    auto pool = luactx_pool(2, [](luactx& l) {
+        l.load_and_call(lua_code{"value = 1 function get() return cppfunc() + value end"});
+        l.provide(LUA_TNAME("cppfunc"), [] { return 2; });
+    });
+    REQUIRE(pool.available() == 2);
+
+    SECTION("globals are restored") {
+        {
+            auto lease = pool.checkout();
+            REQUIRE(pool.available() == 1);
+            lease->load_and_call(lua_code{"value = 10 extra = {} cppfunc = nil get = function() return 0 end"});
+            REQUIRE(lease->extract<int>(LUA_TNAME("value")) == 10);
+        }
+        REQUIRE(pool.available() == 2);
+
+        auto lease = pool.checkout();
+        auto top   = lease->top();
+        REQUIRE(lease->extract<int>(LUA_TNAME("value")) == 1);
+        REQUIRE(!lease->extract<std::optional<int>>(LUA_TNAME("extra")));
+        REQUIRE(lease->extract<int()>(LUA_TNAME("get"))() == 3);
+        REQUIRE(lease->top() == top);
+    }
+
+    SECTION("exhausted pool grows") {
+        auto lease1 = pool.checkout();
+        auto lease2 = pool.checkout();
+        auto lease3 = pool.checkout();
+        REQUIRE(pool.available() == 0);
+        REQUIRE(lease3->extract<int()>(LUA_TNAME("get"))() == 3);
+        lease1 = std::move(lease3);
+        REQUIRE(pool.available() == 1);
+    }
+    REQUIRE(pool.available() >= 2);
+}
+
+namespace {
+void write_file(const std::filesystem::path& path, std::string_view content) {
+    auto file = std::ofstream(path, std::ios::binary | std::ios::trunc);
+    file.write(content.data(), std::streamsize(content.size()));
+}
+} // namespace
+
+TEST_CASE("bytecode_cache") {
+    auto dir       = std::filesystem::temp_directory_path() / "luacpp_bytecode_cache_test";
+    auto cache_dir = dir / "cache";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+
+    auto script = (dir / "script.lua").string();
+    write_file(script, "function get() return 1 end");
+
+    auto run = [&] {
+        luactx l;
+        l.enable_bytecode_cache(cache_dir);
+        l.load_and_call(script.data());
+        return l.extract<int()>(LUA_TNAME("get"))();
+    };
+
+    auto entry = bytecode_cache(cache_dir).entry_path(script);
+
+    SECTION("cold and warm loads") {
+        REQUIRE(run() == 1);
+        REQUIRE(std::filesystem::exists(entry));
+        REQUIRE(run() == 1);
+    }
+    SECTION("temporary files are renamed into place") {
+        REQUIRE(run() == 1);
+        write_file(script, "function get() return 2 end");
+        REQUIRE(run() == 2);
+        auto files = std::distance(std::filesystem::directory_iterator(cache_dir), {});
+        REQUIRE(files == 1);
+    }
+    SECTION("source changes invalidate the entry") {
+        REQUIRE(run() == 1);
+        write_file(script, "function get() return 2 end");
+        REQUIRE(run() == 2);
+        REQUIRE(run() == 2);
+    }
+    SECTION("broken entry is replaced") {
+        REQUIRE(run() == 1);
+        write_file(entry, "LUACPPBC broken entry");
+        REQUIRE(run() == 1);
+        REQUIRE(std::filesystem::file_size(entry) > 32);
+    }
+    SECTION("syntax errors are not cached") {
+        write_file(script, "function get() return end end");
+        REQUIRE_THROWS_AS(run(), errors::syntax_error);
+        REQUIRE(!std::filesystem::exists(entry));
+    }
+    SECTION("missing file") {
+        luactx l;
+        l.enable_bytecode_cache(cache_dir);
+        REQUIRE_THROWS_AS(l.load((dir / "missing.lua").string().data()), errors::cannot_open_file);
+    }
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("load_mapped") {
+    auto dir = std::filesystem::temp_directory_path() / "luacpp_load_mapped_test";
+    std::filesystem::create_directories(dir);
+    auto script = (dir / "script.lua").string();
+
+    SECTION("mapped script") {
+        write_file(script, "#!/usr/bin/env luajit\nvalues = {1, 2, 3}\nfunction get() return values[3] end");
+        luactx l;
+        l.load_mapped(script.data());
+        l.call();
+        REQUIRE(l.extract<int()>(LUA_TNAME("get"))() == 3);
+    }
+    SECTION("chunk name in errors") {
+        write_file(script, "\n\nlocal x = = 1");
+        luactx l;
+        try {
+            l.load_mapped(script.data());
+            FAIL("syntax error was not thrown");
+        }
+        catch (const errors::syntax_error& e) {
+            REQUIRE(std::string_view(e.what()).find("script.lua:3:") != std::string_view::npos);
+        }
+    }
+    SECTION("empty file") {
+        write_file(script, "");
+        luactx l;
+        REQUIRE_NOTHROW(l.load_mapped(script.data()));
+    }
+    SECTION("missing file") {
+        luactx l;
+        REQUIRE_THROWS_AS(l.load_mapped((dir / "missing.lua").string().data()), errors::cannot_open_file);
+    }
+    SECTION("with bytecode cache") {
+        write_file(script, "function get() return 42 end");
+        luactx l;
+        l.enable_bytecode_cache(dir / "cache");
+        l.load_mapped(script.data());
+        l.call();
+        REQUIRE(l.extract<int()>(LUA_TNAME("get"))() == 42);
+        REQUIRE(std::filesystem::exists(bytecode_cache(dir / "cache").entry_path(script)));
+    }
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("pooled_allocator") {
+    /* LuaJIT on 64-bit targets does not accept the custom allocators */
+    std::optional<luactx> l;
+    try {
+        l.emplace(pooled_allocator);
+    } catch (const errors::newstate_failed&) {
+        return;
+    }
+
+    /* The panic handler of luaL_newstate is installed */
+    auto panic = lua_atpanic(l->state(), nullptr);
+    REQUIRE(panic != nullptr);
+    lua_atpanic(l->state(), panic);
+
+    l->load_and_call(lua_code{"value = 1 + 2"});
+#if LUA_VERSION_NUM >= 504
+    l->load_and_call(lua_code{"warn('@off') warn('not printed') warn('@on') warn('@off')"});
+#endif
+    REQUIRE(l->extract<int>(LUA_TNAME("value")) == 3);
+}
@@ -1,6 +1,11 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/catch_approx.hpp>
+#include <algorithm>
+#include <numeric>
 #include <array>
+#if __has_include(<expected>)
+#include <expected>
+#endif
 
 #include "lua.hpp"
 
@@ -150,6 +155,374 @@ TEST_CASE("functions") {
         REQUIRE(f3(false).storage == std::tuple{1, 2, 3});
     }
 
+    SECTION("native multiple returns from C++") {
+        auto l = luactx(lua_code{R"(
+            function call_divmod(a, b)
+                local q, r = divmod(a, b)
+                return q * 10 + r
+            end
+            function count_results() return select("#", minmax({3, 1, 2})) end
+            function call_minmax() return minmax({3, 1, 2}) end
+        )"});
+        l.provide(LUA_TNAME("divmod"), [](int a, int b) { return multiresult{a / b, a % b}; });
+        l.provide(LUA_TNAME("minmax"), [](const std::vector<int>& v) {
+            auto [min, max] = std::minmax_element(v.begin(), v.end());
+            return multiresult<int, int, std::string>(*min, *max, "ok");
+        });
+
+        auto top = l.top();
+        REQUIRE(l.extract<int(int, int)>(LUA_TNAME("call_divmod"))(17, 5) == 32);
+        REQUIRE(l.extract<int()>(LUA_TNAME("count_results"))() == 3);
+        REQUIRE(l.extract<multiresult<int, int, std::string>()>(LUA_TNAME("call_minmax"))().storage ==
+                std::tuple{1, 3, std::string("ok")});
+        REQUIRE(l.top() == top);
+    }
+
+    SECTION("borrowed string arguments") {
+        auto l = luactx(lua_code{R"(
+            function call_view() return view_points_to_lua("some long string which does not fit the SSO buffer") end
+            function call_cstr(s) return cstr_points_to_lua(s) end
+            function call_overloaded(v) return overloaded(v) end
+        )"});
+        l.provide(LUA_TNAME("view_points_to_lua"),
+                  [&l](std::string_view str) { return str.data() == lua_tostring(l.state(), 1) && str.size() == 50; });
+        l.provide(LUA_TNAME("cstr_points_to_lua"), [&l](const char* str) {
+            return str == nullptr ? std::string("null") : std::string(str == lua_tostring(l.state(), 1) ? "1" : "0");
+        });
+        l.provide(
+            LUA_TNAME("overloaded"),
+            [](int v) { return std::to_string(v); },
+            [](std::string_view str) { return "view:" + std::string(str); });
+
+        REQUIRE(l.extract<bool()>(LUA_TNAME("call_view"))());
+        REQUIRE(l.extract<std::string(const char*)>(LUA_TNAME("call_cstr"))("abc") == "1");
+        REQUIRE(l.extract<std::string(std::nullptr_t)>(LUA_TNAME("call_cstr"))(nullptr) == "null");
+        REQUIRE(l.extract<std::string(int)>(LUA_TNAME("call_overloaded"))(2) == "2");
+        REQUIRE(l.extract<std::string(const char*)>(LUA_TNAME("call_overloaded"))("two") == "view:two");
+    }
+
+    SECTION("per-state closures") {
+        auto code = lua_code{"function cppcall() return cppfunc() end"};
+        auto l1   = luactx(code);
+        auto l2   = luactx(code);
+        l1.provide(LUA_TNAME("cppfunc"), [] { return 1; });
+        l2.provide(LUA_TNAME("cppfunc"), [] { return 2; });
+        REQUIRE(l1.extract<int()>(LUA_TNAME("cppcall"))() == 1);
+        REQUIRE(l2.extract<int()>(LUA_TNAME("cppcall"))() == 2);
+
+        auto captured = std::make_shared<int>(3);
+        {
+            luactx l;
+            l.provide(LUA_TNAME("cppfunc"), [captured] { return *captured; });
+            l.provide(
+                LUA_TNAME("cppfunc2"), [captured] { return *captured; }, [captured](int v) { return *captured + v; });
+            REQUIRE(captured.use_count() == 4);
+        }
+        REQUIRE(captured.use_count() == 1);
+    }
+
+    SECTION("overloaded inline cache") {
+        auto l = luactx(lua_code{R"(
+            function cppcall(...) return cppfunc(...) end
+            function cppcall_failed(...) return pcall(cppfunc, ...) end
+        )"});
+        auto top = l.top();
+
+        l.provide(
+            LUA_TNAME("cppfunc"),
+            [](double) { return 1; },
+            [](const std::string&) { return 2; },
+            [](const std::vector<int>&) { return 3; },
+            [](const std::vector<std::string>&) { return 4; },
+            [](bool, double) { return 5; },
+            [](double, bool) { return 6; },
+            [](std::optional<double>, const std::string&) { return 7; });
+
+        auto call   = l.extract<int(variable_args)>(LUA_TNAME("cppcall"));
+        auto failed = l.extract<bool(variable_args)>(LUA_TNAME("cppcall_failed"));
+
+        /* Same signatures twice: the first call fills the cache, the second one hits it */
+        for (int i = 0; i < 2; ++i) {
+            REQUIRE(call(1.0) == 1);
+            REQUIRE(call("str") == 2);
+            REQUIRE(call(true, 1.0) == 5);
+        }
+
+        /* Ambiguous by lua_type, resolved by the contents every time */
+        REQUIRE(call(std::vector{1, 2}) == 3);
+        REQUIRE(call(std::vector<std::string>{"a", "b"}) == 4);
+        REQUIRE(call(std::vector{1, 2}) == 3);
+        REQUIRE(call(std::vector<int>{}) == 3);
+
+        /* The cache is full, the binding becomes megamorphic */
+        REQUIRE(call(1.0, true) == 6);
+        REQUIRE(call(std::optional<double>{}, "str") == 7);
+        REQUIRE(call(2.0, "str") == 7);
+        REQUIRE(call(1.0) == 1);
+        REQUIRE(call("str") == 2);
+
+        REQUIRE(!failed(true, true));
+        REQUIRE(!failed(1.0, 2.0, 3.0));
+
+        REQUIRE(top == l.top());
+    }
+
+    SECTION("overloaded inline cache with failed deep check") {
+        auto l = luactx(lua_code{R"(
+            function cppcall(...) return cppfunc(...) end
+            function cppcall_failed(...) return pcall(cppfunc, ...) end
+        )"});
+
+        l.provide(
+            LUA_TNAME("cppfunc"), [](const std::vector<int>&) { return 1; }, [](double, double) { return 2; });
+
+        auto call   = l.extract<int(variable_args)>(LUA_TNAME("cppcall"));
+        auto failed = l.extract<bool(variable_args)>(LUA_TNAME("cppcall_failed"));
+
+        REQUIRE(call(std::vector{1, 2}) == 1);
+        REQUIRE(!failed(std::vector<std::string>{"a"}));
+        REQUIRE(call(std::vector{3}) == 1);
+        REQUIRE(call(1.0, 2.0) == 2);
+    }
+
+    SECTION("integer and float overloads") {
+        auto l = luactx(lua_code{R"(
+            function cppcall(...) return cppfunc(...) end
+            function cppcall_failed(...) return pcall(cppfunc, ...) end
+            function half() return 2.5 end
+            function nan() return 0/0 end
+            function huge() return -1e300 end
+        )"});
+        auto top = l.top();
+
+        l.provide(
+            LUA_TNAME("cppfunc"),
+            [](double) { return 1; },
+            [](int64_t) { return 2; },
+            [](double, int64_t) { return 3; },
+            [](int64_t, double) { return 4; },
+            [](const std::string&, double) { return 5; });
+
+        auto call   = l.extract<int(variable_args)>(LUA_TNAME("cppcall"));
+        auto failed = l.extract<bool(variable_args)>(LUA_TNAME("cppcall_failed"));
+
+        /* The second iteration goes through the inline cache */
+        for (int i = 0; i < 2; ++i) {
+            REQUIRE(call(1.5) == 1);
+            REQUIRE(call(int64_t(1)) == 2);
+            REQUIRE(call(1.5, int64_t(2)) == 3);
+            REQUIRE(call(int64_t(1), 2.5) == 4);
+            /* No exact match: the first overload, which accepts the arguments */
+            REQUIRE(call(int64_t(1), int64_t(2)) == 3);
+            REQUIRE(call("str", int64_t(1)) == 5);
+        }
+
+#if LUA_VERSION_NUM >= 503
+        /* Float subtype, the integer parameters accept the integral values only */
+        REQUIRE(call(1.0) == 1);
+        REQUIRE(call(2.0, 1.0) == 3);
+        REQUIRE(!failed(1.5, 2.5));
+        REQUIRE(l.extract<int64_t()>(LUA_TNAME("half"))() == 2);
+#else
+        /* LuaJIT: no integer subtype, the integral values are integers, any number is accepted */
+        REQUIRE(call(1.0) == 2);
+        REQUIRE(call(1.5, 2.5) == 3);
+        REQUIRE(l.extract<int64_t()>(LUA_TNAME("half"))() == 2);
+#endif
+        REQUIRE(!failed(true));
+
+        /* The integer arrays check the elements like the integer scalars */
+        l.provide(
+            LUA_TNAME("cppfunc"),
+            [](const std::vector<int64_t>&) { return 1; },
+            [](const std::vector<double>&) { return 2; });
+        REQUIRE(call(std::vector{1.0, 2.0}) == 1);
+#if LUA_VERSION_NUM >= 503
+        REQUIRE(call(std::vector{1.0, 2.5}) == 2);
+        l.push(std::vector{1.0, 2.5});
+        REQUIRE(!luacheck<std::array<int, 2>>(l.state(), -1));
+        lua_pop(l.state(), 1);
+#else
+        REQUIRE(call(std::vector{1.0, 2.5}) == 1);
+#endif
+
+        /* The integers out of the range of the integer parameter go to the float one, also through the cache */
+        l.provide(
+            LUA_TNAME("cppfunc"), [](int32_t) { return 1; }, [](double) { return 2; });
+        for (int i = 0; i < 2; ++i) {
+            REQUIRE(call(int64_t(1) << 40) == 2);
+            REQUIRE(call(int64_t(1)) == 1);
+            REQUIRE(call(-(int64_t(1) << 40)) == 2);
+            REQUIRE(call(1e300) == 2);
+        }
+        l.provide(
+            LUA_TNAME("cppfunc"), [](int64_t) { return 1; }, [](double) { return 2; });
+        for (int i = 0; i < 2; ++i) {
+            REQUIRE(call(1e300) == 2);
+            REQUIRE(call(int64_t(1)) == 1);
+            REQUIRE(call(-1e300) == 2);
+        }
+        l.provide(
+            LUA_TNAME("cppfunc"), [](uint8_t) { return 1; }, [](double) { return 2; });
+        REQUIRE(call(int64_t(255)) == 1);
+        REQUIRE(call(int64_t(256)) == 2);
+        REQUIRE(call(int64_t(-1)) == 2);
+
+        /* Not representable values are not casted to the integers */
+        REQUIRE(l.extract<int64_t()>(LUA_TNAME("nan"))() == 0);
+        REQUIRE(l.extract<int32_t()>(LUA_TNAME("huge"))() == 0);
+        REQUIRE(l.extract<uint8_t()>(LUA_TNAME("half"))() == 2);
+
+        REQUIRE(top == l.top());
+    }
+
+    SECTION("ffi functions") {
+        auto l = luactx(lua_code{R"(
+            function call_mad(N)
+                local s = 0
+                for i = 1, N do s = mad(s, 0.5, i) end
+                return s
+            end
+            function call_flags() return both(true, false), both(true, true), half(7) end
+            function call_sum() local a = typed_array.float64({1, 2, 3}) return sum_array(a:ptr(), #a) end
+        )"});
+        auto top = l.top();
+
+        l.provide_ffi(LUA_TNAME("mad"), [](double a, double b, double c) noexcept { return a * b + c; });
+        l.provide_ffi(LUA_TNAME("both"), [](bool a, bool b) noexcept { return a && b; });
+        l.provide_ffi(LUA_TNAME("half"), [](int32_t v) noexcept { return v / 2; });
+
+        REQUIRE(l.extract<double(int)>(LUA_TNAME("call_mad"))(3) == 4.25_a);
+        REQUIRE(l.extract<multiresult<bool, bool, int>()>(LUA_TNAME("call_flags"))().storage ==
+                std::tuple{false, true, 3});
+
+        auto sum_array = [](const double* data, int32_t size) noexcept {
+            return std::accumulate(data, data + size, 0.0);
+        };
+#ifdef WITH_LUAJIT
+        l.provide_typed_arrays();
+        l.provide_ffi(LUA_TNAME("sum_array"), sum_array);
+        REQUIRE(l.extract<double()>(LUA_TNAME("call_sum"))() == 6.0_a);
+#else
+        /* Pointer arguments can't be passed without the FFI */
+        REQUIRE_THROWS_AS(l.provide_ffi(LUA_TNAME("sum_array"), sum_array), errors::ffi_error);
+#endif
+        REQUIRE(l.top() == top);
+    }
+
+    SECTION("unchecked bindings") {
+        auto l = luactx(lua_code{R"(
+            function call_mad(a, b, c) return mad(a, b, c) end
+            function call_pick(flag, a, b) return pick(flag, a, b) end
+            function call_length(s) return length(s) end
+            function call_vec_sum(v) return vec_sum(v) end
+        )"});
+        auto top = l.top();
+
+        l.provide_unchecked(LUA_TNAME("mad"), [](double a, double b, double c) { return a * b + c; });
+        l.provide_unchecked(LUA_TNAME("pick"), [](bool flag, int a, int b) { return flag ? a : b; });
+        l.provide_unchecked(LUA_TNAME("length"), [](std::string_view str) { return int(str.size()); });
+        l.provide_unchecked(LUA_TNAME("vec_sum"), [](const luavec3& v) { return v.x + v.y + v.z; });
+
+        REQUIRE(l.extract<double(double, double, double)>(LUA_TNAME("call_mad"))(2.0, 3.0, 1.0) == 7.0_a);
+        REQUIRE(l.extract<int(bool, int, int)>(LUA_TNAME("call_pick"))(true, 1, 2) == 1);
+        REQUIRE(l.extract<int(bool, int, int)>(LUA_TNAME("call_pick"))(false, 1, 2) == 2);
+        REQUIRE(l.extract<int(const char*)>(LUA_TNAME("call_length"))("four") == 4);
+        REQUIRE(l.extract<double(const luavec3&)>(LUA_TNAME("call_vec_sum"))(luavec3(1, 2, 3)) == 6.0_a);
+
+        /* The referencing storages are resolved too */
+        auto v = luavec3(2, 2, 2);
+        REQUIRE(l.extract<double(borrowed<luavec3>)>(LUA_TNAME("call_vec_sum"))(borrow(v)) == 6.0_a);
+        REQUIRE(l.top() == top);
+    }
+
+    SECTION("result bindings") {
+        auto l = luactx(lua_code{R"(
+            function call_div(a, b) return safe_div(a, b) end
+            function call_divmod(a, b) local q, r = divmod(a, b) return q * 100 + r end
+            function div_error(a, b) local ok, err = pcall(safe_div, a, b) assert(not ok) return err end
+            function check_error(v) local ok, err = pcall(check, v) assert(not ok) return err end
+            function bad_argument() local ok, err = pcall(safe_div, "one", 2) assert(not ok) return err end
+            function bad_count() local ok, err = pcall(safe_div, 1) assert(not ok) return err end
+            function throw_error() local ok, err = pcall(thrower) assert(not ok) return err end
+            function call_parse(v) return parse(v) end
+            function parse_error() local ok, err = pcall(parse, "") assert(not ok) return err end
+        )"});
+        auto top = l.top();
+
+        struct guard {
+            ~guard() {
+                ++counter;
+            }
+            int& counter;
+        };
+        int destroyed = 0;
+
+        l.provide(LUA_TNAME("safe_div"), [&destroyed](int a, int b) noexcept -> result<int> {
+            guard g{destroyed};
+            if (b == 0)
+                return result_error{"division by zero (100%s of calls)"};
+            return a / b;
+        });
+        l.provide(LUA_TNAME("divmod"), [](int a, int b) noexcept -> result<multiresult<int, int>> {
+            if (b == 0)
+                return result_error{"division by zero"};
+            return multiresult{a / b, a % b};
+        });
+        l.provide(LUA_TNAME("check"), [](int v) noexcept -> result<> {
+            if (v < 0)
+                return result_error{"negative"};
+            return {};
+        });
+        l.provide(LUA_TNAME("thrower"), [] { throw std::runtime_error("thrown %d %s"); });
+
+        REQUIRE(l.extract<int(int, int)>(LUA_TNAME("call_div"))(7, 2) == 3);
+        REQUIRE(l.extract<int(int, int)>(LUA_TNAME("call_divmod"))(7, 2) == 301);
+        REQUIRE(destroyed == 1);
+
+        /* The message is not a format string, the locals are destroyed before the error is raised */
+        auto error = l.extract<std::string(int, int)>(LUA_TNAME("div_error"))(1, 0);
+        REQUIRE(error.find("division by zero (100%s of calls)") != std::string::npos);
+        REQUIRE(destroyed == 2);
+
+        REQUIRE(l.extract<std::string(int)>(LUA_TNAME("check_error"))(-1).find("negative") != std::string::npos);
+        REQUIRE(l.extract<std::string()>(LUA_TNAME("bad_argument"))().find("bad argument #1") != std::string::npos);
+        REQUIRE(l.extract<std::string()>(LUA_TNAME("bad_count"))().find("arguments count mismatch") !=
+                std::string::npos);
+        REQUIRE(destroyed == 2);
+
+        /* Overloaded sets raise the errors of the results the same way */
+        l.provide(
+            LUA_TNAME("parse"),
+            [](int v) -> result<int> { return v; },
+            [&destroyed](const std::string& str) -> result<int> {
+                guard g{destroyed};
+                if (str.empty())
+                    return result_error{"empty %s"};
+                return int(str.size());
+            });
+        REQUIRE(l.extract<int(int)>(LUA_TNAME("call_parse"))(5) == 5);
+        REQUIRE(l.extract<int(const std::string&)>(LUA_TNAME("call_parse"))("four") == 4);
+        REQUIRE(l.extract<std::string()>(LUA_TNAME("parse_error"))().find("empty %s") != std::string::npos);
+        REQUIRE(destroyed == 4);
+
+        /* Exceptions of the regular bindings are not format strings too */
+        REQUIRE(l.extract<std::string()>(LUA_TNAME("throw_error"))().find("thrown %d %s") != std::string::npos);
+
+#ifdef __cpp_lib_expected
+        l.provide(LUA_TNAME("safe_div"), [](int a, int b) noexcept -> std::expected<int, std::string> {
+            if (b == 0)
+                return std::unexpected("expected: division by zero");
+            return a / b;
+        });
+        REQUIRE(l.extract<int(int, int)>(LUA_TNAME("call_div"))(9, 3) == 3);
+        REQUIRE(l.extract<std::string(int, int)>(LUA_TNAME("div_error"))(1, 0).find("expected: division by zero") !=
+                std::string::npos);
+#endif
+
+        REQUIRE(l.top() == top);
+    }
+
     SECTION("explicit return") {
         auto l      = luactx(lua_code{"function cppcall() a, b = cppfunc() assert(a == 'a') assert(b == 'b') end"});
         auto top    = l.top();
@@ -1,12 +1,10 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
-#include <cmath>
 
-template <typename T, typename U, typename E = decltype(T{} + U{})>
-constexpr bool approx_eq(T a, U b, E epsilon = std::numeric_limits<E>::epsilon() * 100) {
-    return std::fabs(a - b) <= ((std::fabs(a) < std::fabs(b) ? std::fabs(b) : std::fabs(a)) * epsilon);
-}
+#include "simd4.hpp"
+#include "vector3.hpp"
 
 struct string_like {
     std::string str;
@@ -22,77 +20,69 @@ struct string_like {
     }
 };
 
-template <typename T>
-struct vector3 {
-    constexpr vector3() noexcept = default;
-    constexpr vector3(T v) noexcept: x(v), y(v), z(v) {}
-    constexpr vector3(T ix, T iy, T iz) noexcept: x(ix), y(iy), z(iz) {}
-
-    template <typename U>
-    constexpr auto operator+(const vector3<U>& v) const noexcept {
-        return vector3{x + v.x, y + v.y, z + v.z};
-    }
-
-    template <typename U>
-    constexpr auto operator-(const vector3<U>& v) const noexcept {
-        return vector3{x - v.x, y - v.y, z - v.z};
-    }
-
-    template <typename U>
-    constexpr auto operator*(U n) const noexcept {
-        return vector3{x * n, y * n, z * n};
+/* Over-aligned types, the payload must be placed at the aligned address */
+struct alignas(32) simd_vec4 {
+    simd_vec4 operator+(const simd_vec4& rhs) const {
+        simd_vec4 result;
+        simd4::add_aligned(v, rhs.v, result.v);
+        return result;
     }
-
-    template <typename U>
-    friend constexpr auto operator*(U n, const vector3& vec) noexcept {
-        return vector3{vec.x * n, vec.y * n, vec.z * n};
+    double sum() const {
+        return v[0] + v[1] + v[2] + v[3];
     }
 
-    template <typename U>
-    constexpr auto operator/(U n) const noexcept {
-        return vector3{x / n, y / n, z / n};
-    }
+    double v[4];
+};
 
-    template <typename U>
-    constexpr auto dot(const vector3<U>& v) const noexcept {
-        return x * v.x + y * v.y + z * v.z;
-    }
+struct alignas(64) cache_line_counter {
+    uint64_t value;
+};
 
-    constexpr auto magnitude2() const noexcept {
-        return dot(*this);
-    }
+/* Intrusive reference counter, the object is never deleted for the test purposes */
+struct refcounted_object {
+    int value    = 0;
+    int refcount = 0;
+};
 
-    auto magnitude() const noexcept {
-        auto m2 = magnitude2();
-        return std::sqrt(sizeof(T) > 4 ? double(m2) : float(m2));
-    }
+inline void intrusive_ptr_add_ref(refcounted_object* ptr) {
+    ++ptr->refcount;
+}
 
-    template <typename U>
-    constexpr auto cross(const vector3<U>& v) const noexcept {
-        return vector3{
-            y * v.z - z * v.y,
-            z * v.x - x * v.z,
-            x * v.y - y * v.x
-        };
-    }
+inline void intrusive_ptr_release(refcounted_object* ptr) {
+    --ptr->refcount;
+}
 
-    template <typename U>
-    constexpr bool operator==(const vector3<U>& v) const noexcept {
-        return approx_eq(x, v.x) && approx_eq(y, v.y) && approx_eq(z, v.z);
+/* Standard-layout type which is represented by the FFI cdata under LuaJIT */
+struct ffi_point {
+    double length() const {
+        return x * x + y * y;
     }
 
-    T x, y, z;
+    double  x;
+    double  y;
+    int32_t id;
 };
 
-
 #include "luacpp_basic.hpp"
 
 
 using luavec3 = vector3<double>;
 
+/* The first member shares the address with the object */
+struct particle {
+    luavec3 position;
+    int     id = 0;
+};
+
 template <>
 struct luacpp::typespec_list_s<0> {
-    using type = std::tuple<typespec<luavec3, LUA_TNAME("vec3")>, typespec<string_like, LUA_TNAME("string_like")>>;
+    using type = std::tuple<typespec<luavec3, LUA_TNAME("vec3")>,
+                            typespec<string_like, LUA_TNAME("string_like")>,
+                            typespec<simd_vec4, LUA_TNAME("simd_vec4")>,
+                            typespec<cache_line_counter, LUA_TNAME("cache_line_counter")>,
+                            typespec<refcounted_object, LUA_TNAME("refcounted_object")>,
+                            typespec<ffi_point, LUA_TNAME("ffi_point"), luacpp::typespec_options{.ffi_struct = true}>,
+                            typespec<particle, LUA_TNAME("particle")>>;
 };
 
 #include "luacpp_ctx.hpp"
@@ -0,0 +1,50 @@
+#pragma once
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define LUACPP_TESTS_AVX
+#endif
+
+/* Additions of 4 doubles for the over-aligned test types.
+ * The AVX kernels are compiled with the target attribute (the tests are built without -mavx)
+ * and are selected at runtime, the scalar loop is used on the CPUs without AVX
+ */
+namespace simd4
+{
+#ifdef LUACPP_TESTS_AVX
+    inline bool has_avx() {
+        static const bool avx = __builtin_cpu_supports("avx");
+        return avx;
+    }
+
+    /* Aligned loads and stores fault on the misaligned address */
+    __attribute__((target("avx"))) inline void add_aligned_avx(const double* a, const double* b, double* result) {
+        _mm256_store_pd(result, _mm256_add_pd(_mm256_load_pd(a), _mm256_load_pd(b)));
+    }
+
+    __attribute__((target("avx"))) inline void add_unaligned_avx(const double* a, const double* b, double* result) {
+        _mm256_storeu_pd(result, _mm256_add_pd(_mm256_loadu_pd(a), _mm256_loadu_pd(b)));
+    }
+#endif
+
+    inline void add_scalar(const double* a, const double* b, double* result) {
+        for (int i = 0; i < 4; ++i) result[i] = a[i] + b[i];
+    }
+
+    /* The pointers must be 32-byte aligned */
+    inline void add_aligned(const double* a, const double* b, double* result) {
+#ifdef LUACPP_TESTS_AVX
+        if (has_avx())
+            return add_aligned_avx(a, b, result);
+#endif
+        add_scalar(a, b, result);
+    }
+
+    inline void add_unaligned(const double* a, const double* b, double* result) {
+#ifdef LUACPP_TESTS_AVX
+        if (has_avx())
+            return add_unaligned_avx(a, b, result);
+#endif
+        add_scalar(a, b, result);
+    }
+} // namespace simd4
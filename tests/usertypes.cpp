@@ -146,6 +146,12 @@ TEST_CASE("usertypes") {
         lua_setup_usertypes(l);
         l.extract<void()>(LUA_TNAME("test"))();
     }
+    SECTION("pooled allocator") {
+        auto l = luactx(pooled_allocator);
+        l.load_and_call(lua_code{code});
+        lua_setup_usertypes(l);
+        l.extract<void()>(LUA_TNAME("test"))();
+    }
     SECTION("field not exists") {
         luactx l;
         lua_setup_usertypes(l);
@@ -183,9 +189,513 @@ TEST_CASE("usertypes") {
         lua_setup_usertypes(l);
         REQUIRE(l.generate_assist() == assist_txt);
     }
+    SECTION("metatable does not depend on the global") {
+        auto l = luactx(lua_code{code});
+        lua_setup_usertypes(l);
+        l.load_and_call(lua_code{"local v = vec3 vec3 = nil r = (v.new(1, 2, 3) * 2):dot(v.new(1))"});
+        REQUIRE(l.extract<double>(LUA_TNAME("r")) == 12.0_a);
+
+        l.push(luavec3(1, 2, 3));
+        lua_setglobal(l.state(), "pushed");
+        l.load_and_call(lua_code{"m = pushed:magnitude() s = tostring(pushed + pushed)"});
+        REQUIRE(l.extract<double>(LUA_TNAME("m")) == Catch::Approx(std::sqrt(14.0)));
+        REQUIRE(l.extract<std::string>(LUA_TNAME("s")).starts_with("2.0"));
+    }
+    SECTION("interned member table") {
+        auto l = luactx(lua_code{code});
+        lua_setup_usertypes(l);
+        l.set_member_table(interned_member_table<luavec3>{
+            lua_getsetez(x),
+            lua_getsetez(y),
+            lua_getez(z),
+            {"a_field_name_that_is_too_long_to_be_interned_by_lua", {[](const luavec3& v, luactx& ctx) {
+                 ctx.push(v.x + v.y + v.z);
+             }}}});
+
+        auto top = l.top();
+        l.load_and_call(lua_code{R"(
+            v = vec3.new(1, 2, 3)
+            v.x = 10
+            v.y = v.y * 2
+            sum = v.x + v.y + v.z
+            long = v.a_field_name_that_is_too_long_to_be_interned_by_lua
+            mag = vec3.new(4, 2, -4):magnitude()
+            missing = v.unknown == nil
+            set_private = pcall(function() v.z = 1 end)
+            set_unknown = pcall(function() v.unknown = 1 end)
+            co_sum = coroutine.wrap(function(a, b)
+                local u = vec3.new(a, b, 0)
+                u.x = u.x + coroutine.yield(u.y)
+                return u.x + u.y + u.z + #tostring(u.unknown)
+            end)
+            co_yielded = co_sum(1, 2)
+            co_result = co_sum(5)
+        )"});
+        REQUIRE(l.extract<double>(LUA_TNAME("sum")) == 17.0_a);
+        REQUIRE(l.extract<double>(LUA_TNAME("long")) == 17.0_a);
+        REQUIRE(l.extract<double>(LUA_TNAME("mag")) == 6.0_a);
+        REQUIRE(l.extract<bool>(LUA_TNAME("missing")));
+        REQUIRE(!l.extract<bool>(LUA_TNAME("set_private")));
+        REQUIRE(!l.extract<bool>(LUA_TNAME("set_unknown")));
+        /* The fields are read and written on the coroutine stack */
+        REQUIRE(l.extract<double>(LUA_TNAME("co_yielded")) == 2.0_a);
+        REQUIRE(l.extract<double>(LUA_TNAME("co_result")) == 11.0_a);
+        REQUIRE(l.top() == top);
+    }
+    SECTION("methods first lookup") {
+        auto l = luactx(lua_code{code});
+        lua_setup_usertypes(l);
+        l.set_member_table(ordered_member_table<luavec3>{lua_getsetez(x), lua_getsetez(y), lua_getsetez(z)},
+                           member_lookup::methods_first);
+        l.extract<void()>(LUA_TNAME("test"))();
+
+        auto top = l.top();
+        l.load_and_call(lua_code{R"(
+            v = vec3.new(1, 2, 3)
+            dot = v:dot(vec3.new(1))
+            v.x = 5
+            x = v.x
+            missing = v.unknown == nil
+            set_unknown = pcall(function() v.unknown = 1 end)
+        )"});
+        REQUIRE(l.extract<double>(LUA_TNAME("dot")) == 6.0_a);
+        REQUIRE(l.extract<double>(LUA_TNAME("x")) == 5.0_a);
+        REQUIRE(l.extract<bool>(LUA_TNAME("missing")));
+        REQUIRE(!l.extract<bool>(LUA_TNAME("set_unknown")));
+        REQUIRE(l.top() == top);
+    }
+    SECTION("finalizers") {
+        static_assert(!typespec<luavec3, LUA_TNAME("vec3")>::has_gc());
+        static_assert(typespec<string_like, LUA_TNAME("string_like")>::has_gc());
+        static_assert(typespec<luavec3, LUA_TNAME("vec3"), typespec_options{.gc = usertype_gc::force_gc}>::has_gc());
+        static_assert(!typespec<string_like, LUA_TNAME("string_like"), typespec_options{.gc = usertype_gc::no_gc}>::has_gc());
+
+        luactx l;
+        lua_setup_usertypes(l);
+        l.load_and_call(lua_code{R"(
+            vec3_gc = rawget(getmetatable(vec3.new(1)), "__gc") ~= nil
+            string_like_gc = type(rawget(string_like, "__gc")) == "function"
+        )"});
+        REQUIRE(!l.extract<bool>(LUA_TNAME("vec3_gc")));
+        REQUIRE(l.extract<bool>(LUA_TNAME("string_like_gc")));
+    }
     SECTION("registered string-like") {
         auto l = luactx(lua_code{"function test_func(v) assert(v:test() == \"test kek\") end"});
         lua_setup_usertypes(l);
         l.extract<void(const string_like&)>(LUA_TNAME("test_func"))(string_like("kek"));
     }
 }
+
+TEST_CASE("aligned usertypes") {
+    auto l = luactx(lua_code{R"(
+        function sum_all(N)
+            local acc = simd_vec4.new(0, 0, 0, 0)
+            local step = simd_vec4.new(1, 2, 3, 4)
+            for i = 1, N do acc = acc + step end
+            return acc:sum()
+        end
+    )"});
+    l.provide(LUA_TNAME("simd_vec4.new"), [](double x, double y, double z, double w) { return simd_vec4{{x, y, z, w}}; });
+    l.provide(LUA_TNAME("__add"), &simd_vec4::operator+);
+    l.provide(LUA_TNAME("sum"), &simd_vec4::sum);
+    auto top = l.top();
+
+    SECTION("payload alignment") {
+        for (int i = 0; i < 64; ++i) {
+            l.push(simd_vec4{{1, 2, 3, double(i)}});
+            l.push(cache_line_counter{uint64_t(i)});
+            auto& counter = l.get<cache_line_counter&>(-1);
+            auto& vec     = l.get<simd_vec4&>(-2);
+            REQUIRE(reinterpret_cast<uintptr_t>(&counter) % 64 == 0);
+            REQUIRE(reinterpret_cast<uintptr_t>(&vec) % 32 == 0);
+            REQUIRE(counter.value == uint64_t(i));
+            REQUIRE(vec.sum() == Catch::Approx(6.0 + i));
+            REQUIRE(l.get<cache_line_counter*>(-1) == &counter);
+            REQUIRE(luacheck<simd_vec4&>(l.state(), -2));
+            REQUIRE(!luacheck<simd_vec4&>(l.state(), -1));
+            lua_pop(l.state(), 2);
+        }
+        REQUIRE(l.top() == top);
+    }
+
+    SECTION("simd arithmetic") {
+        REQUIRE(l.extract<double(int)>(LUA_TNAME("sum_all"))(1000) == 10000.0_a);
+        REQUIRE(l.top() == top);
+    }
+}
+
+TEST_CASE("borrowed usertypes") {
+    auto l = luactx(lua_code{code});
+    lua_setup_usertypes(l);
+    l.load_and_call(lua_code{R"(
+        function scale(v, k) v.x = v.x * k v.y = v.y * k v.z = v.z * k return v:magnitude() end
+        function try_read(v) return pcall(function() return v.x end) end
+        function keep(v) kept = v end
+    )"});
+    auto top = l.top();
+
+    SECTION("no copy") {
+        auto v   = luavec3(4, 2, -4);
+        auto mag = l.extract<double(borrowed<luavec3>, double)>(LUA_TNAME("scale"))(borrow(v), 2);
+        REQUIRE(mag == 12.0_a);
+        REQUIRE(v.x == 8.0_a);
+        REQUIRE(v.z == Catch::Approx(-8.0));
+
+        l.push(borrow(v));
+        REQUIRE(l.get<luavec3*>(-1) == &v);
+        REQUIRE(luacheck<const luavec3&>(l.state(), -1));
+        REQUIRE(!luacheck<string_like&>(l.state(), -1));
+        lua_pop(l.state(), 1);
+        REQUIRE(l.top() == top);
+    }
+
+    SECTION("generation check") {
+        auto     v          = luavec3(1, 2, 3);
+        uint64_t generation = 0;
+        l.extract<void(borrowed<luavec3>)>(LUA_TNAME("keep"))(borrow(v, generation));
+
+        l.load_and_call(lua_code{"ok, x = try_read(kept)"});
+        REQUIRE(l.extract<bool>(LUA_TNAME("ok")));
+        REQUIRE(l.extract<double>(LUA_TNAME("x")) == 1.0_a);
+
+        ++generation;
+        l.load_and_call(lua_code{"ok = try_read(kept)"});
+        REQUIRE(!l.extract<bool>(LUA_TNAME("ok")));
+        lua_getglobal(l.state(), "kept");
+        REQUIRE(!luacheck<luavec3&>(l.state(), -1));
+        REQUIRE_THROWS_AS(l.get<luavec3&>(-1), errors::cast_error);
+        lua_pop(l.state(), 1);
+        REQUIRE(l.top() == top);
+    }
+
+    SECTION("no destructor call") {
+        auto s = string_like("borrowed");
+        l.extract<void(borrowed<string_like>)>(LUA_TNAME("keep"))(borrow(s));
+        l.load_and_call(lua_code{"kept = nil collectgarbage() collectgarbage()"});
+        REQUIRE(s.str == "borrowed");
+        REQUIRE(l.top() == top);
+    }
+}
+
+TEST_CASE("shared usertypes") {
+    auto l = luactx(lua_code{R"(
+        function call_test(v) return v:test() end
+        function keep(v) kept = v end
+        function release() kept = nil collectgarbage() collectgarbage() end
+        function release_in_coroutine()
+            kept = nil
+            coroutine.wrap(function(...) collectgarbage() collectgarbage() end)("slot", "values")
+        end
+    )"});
+    lua_setup_usertypes(l);
+    l.provide(LUA_TNAME("refcounted_object.value"), [](const refcounted_object& o) { return o.value; });
+    auto top = l.top();
+
+    SECTION("shared_ptr") {
+        auto object = std::make_shared<string_like>("shared");
+        REQUIRE(l.extract<std::string(const std::shared_ptr<string_like>&)>(LUA_TNAME("call_test"))(object) ==
+                "test shared");
+
+        l.extract<void(const std::shared_ptr<string_like>&)>(LUA_TNAME("keep"))(object);
+        REQUIRE(object.use_count() == 2);
+
+        lua_getglobal(l.state(), "kept");
+        REQUIRE(&l.get<string_like&>(-1) == object.get());
+        REQUIRE(luacheck<std::shared_ptr<string_like>>(l.state(), -1));
+        REQUIRE(l.get<std::shared_ptr<string_like>>(-1) == object);
+        lua_pop(l.state(), 1);
+
+        l.push(string_like("value"));
+        REQUIRE(!luacheck<std::shared_ptr<string_like>>(l.state(), -1));
+        REQUIRE_THROWS_AS(l.get<std::shared_ptr<string_like>>(-1), errors::cast_error);
+        lua_pop(l.state(), 1);
+
+        l.extract<void()>(LUA_TNAME("release"))();
+        REQUIRE(object.use_count() == 1);
+        REQUIRE(l.top() == top);
+    }
+
+    SECTION("finalizer in coroutine") {
+        auto object = std::make_shared<string_like>("shared");
+        l.extract<void(const std::shared_ptr<string_like>&)>(LUA_TNAME("keep"))(object);
+        l.push(string_like("on the main stack"));
+        REQUIRE(object.use_count() == 2);
+
+        /* __gc runs on the coroutine state */
+        l.extract<void()>(LUA_TNAME("release_in_coroutine"))();
+        REQUIRE(object.use_count() == 1);
+        REQUIRE(l.get<string_like&>(-1).str == "on the main stack");
+        lua_pop(l.state(), 1);
+        REQUIRE(l.top() == top);
+    }
+
+    SECTION("intrusive") {
+        auto object = refcounted_object{.value = 42};
+        l.extract<void(intrusive_ref<refcounted_object>)>(LUA_TNAME("keep"))({&object});
+        REQUIRE(object.refcount == 1);
+
+        l.load_and_call(lua_code{"v = kept:value()"});
+        REQUIRE(l.extract<int>(LUA_TNAME("v")) == 42);
+
+        lua_getglobal(l.state(), "kept");
+        REQUIRE(l.get<refcounted_object*>(-1) == &object);
+        lua_pop(l.state(), 1);
+
+        l.extract<void()>(LUA_TNAME("release"))();
+        REQUIRE(object.refcount == 0);
+
+        l.extract<void(intrusive_ref<refcounted_object>)>(LUA_TNAME("keep"))({&object});
+        l.extract<void()>(LUA_TNAME("release_in_coroutine"))();
+        REQUIRE(object.refcount == 0);
+        REQUIRE(l.top() == top);
+    }
+
+    SECTION("shared_ptr without the value finalizer") {
+        auto object = std::make_shared<luavec3>(1, 2, 3);
+        l.extract<void(const std::shared_ptr<luavec3>&)>(LUA_TNAME("keep"))(object);
+        REQUIRE(object.use_count() == 2);
+
+        /* The owning userdata share the metatable with the values, the metamethods defined later included */
+        l.load_and_call(lua_code{R"(
+            shared_gc = rawget(getmetatable(kept), "__gc") ~= nil
+            same_metatable = getmetatable(kept) == getmetatable(vec3.new(1))
+            shared_x = kept.x
+            vec3.__concat = function(a, b) return a.x + b.x end
+            shared_concat = kept .. vec3.new(2)
+        )"});
+        REQUIRE(l.extract<bool>(LUA_TNAME("shared_gc")));
+        REQUIRE(l.extract<bool>(LUA_TNAME("same_metatable")));
+        REQUIRE(l.extract<double>(LUA_TNAME("shared_x")) == 1.0_a);
+        REQUIRE(l.extract<double>(LUA_TNAME("shared_concat")) == 3.0_a);
+
+        /* The values collected with the installed __gc are left as is */
+        l.load_and_call(lua_code{"for i = 1, 100 do vec3.new(i) end collectgarbage()"});
+
+        l.extract<void()>(LUA_TNAME("release"))();
+        REQUIRE(object.use_count() == 1);
+        REQUIRE(l.top() == top);
+    }
+}
+
+TEST_CASE("identity cache") {
+    auto l = luactx(lua_code{R"(
+        function keep(v) kept = v end
+        function same(v) return rawequal(v, kept) end
+        function release() kept = nil collectgarbage() collectgarbage() end
+        function keep_other(v) other = v end
+        function same_other(v) return rawequal(v, other) end
+    )"});
+    lua_setup_usertypes(l);
+    auto keep    = l.extract<void(borrowed<luavec3>)>(LUA_TNAME("keep"));
+    auto same    = l.extract<bool(borrowed<luavec3>)>(LUA_TNAME("same"));
+    auto release = l.extract<void()>(LUA_TNAME("release"));
+    auto top     = l.top();
+
+    SECTION("disabled") {
+        auto v = luavec3(1);
+        keep(borrow(v));
+        REQUIRE(!same(borrow(v)));
+        REQUIRE(l.identity_cache_statistics().hits == 0);
+        REQUIRE(l.identity_cache_statistics().misses == 0);
+    }
+
+    SECTION("borrowed") {
+        l.enable_identity_cache();
+        auto v = luavec3(1);
+        auto w = luavec3(2);
+        keep(borrow(v));
+        REQUIRE(same(borrow(v)));
+        REQUIRE(!same(borrow(w)));
+        REQUIRE(l.identity_cache_statistics().hits == 1);
+        REQUIRE(l.identity_cache_statistics().misses == 2);
+
+        uint64_t generation = 0;
+        REQUIRE(!same(borrow(v, generation)));
+
+        release();
+        keep(borrow(v));
+        REQUIRE(l.identity_cache_statistics().hits == 1);
+        REQUIRE(l.identity_cache_statistics().misses == 4);
+        REQUIRE(l.top() == top);
+    }
+
+    SECTION("struct and its first member") {
+        l.enable_identity_cache();
+        auto p = particle{luavec3(1, 2, 3), 7};
+        l.extract<void(borrowed<particle>)>(LUA_TNAME("keep_other"))(borrow(p));
+        keep(borrow(p.position));
+
+        /* Same address, different types: both userdata stay cached */
+        REQUIRE(l.extract<bool(borrowed<particle>)>(LUA_TNAME("same_other"))(borrow(p)));
+        REQUIRE(same(borrow(p.position)));
+        REQUIRE(l.identity_cache_statistics().hits == 2);
+        REQUIRE(l.identity_cache_statistics().misses == 2);
+        REQUIRE(l.top() == top);
+    }
+
+    SECTION("shared_ptr") {
+        l.enable_identity_cache();
+        auto object = std::make_shared<string_like>("shared");
+        l.extract<void(const std::shared_ptr<string_like>&)>(LUA_TNAME("keep"))(object);
+        REQUIRE(l.extract<bool(const std::shared_ptr<string_like>&)>(LUA_TNAME("same"))(object));
+        REQUIRE(object.use_count() == 2);
+        REQUIRE(l.identity_cache_statistics().hits == 1);
+        release();
+        REQUIRE(object.use_count() == 1);
+        REQUIRE(l.top() == top);
+    }
+}
+
+TEST_CASE("typed_array") {
+    auto l = luactx(lua_code{R"(
+        function sum(a)
+            local s = 0
+            for i = 1, #a do s = s + a[i] end
+            return s
+        end
+        function fill(a, v)
+            for i = 1, #a do a[i] = v * i end
+        end
+        function make() return typed_array.int32({1, 2, 3}) end
+        function out_of_range(a) return pcall(function() return a[#a + 1] end) end
+        function set_string(a) return pcall(function() a[1] = "str" end) end
+    )"});
+    l.provide_typed_arrays();
+    auto top = l.top();
+
+    SECTION("shared storage") {
+        auto data = l.provide(LUA_TNAME("values"), typed_array<double>(4));
+        REQUIRE(data.size() == 4);
+        data[0] = 1.5;
+        data[3] = 2.5;
+        l.load_and_call(lua_code{"total = sum(values)"});
+        REQUIRE(l.extract<double>(LUA_TNAME("total")) == 4.0_a);
+        REQUIRE(top == l.top());
+    }
+
+    SECTION("lua side access") {
+        auto values = std::vector<float>{1.f, 2.f, 3.f};
+        auto data   = l.provide(LUA_TNAME("values"), typed_array<float>(std::span<const float>(values)));
+        l.load_and_call(lua_code{"total = sum(values) fill(values, 2) len = #values"});
+        REQUIRE(l.extract<double>(LUA_TNAME("total")) == 6.0_a);
+        REQUIRE(l.extract<int>(LUA_TNAME("len")) == 3);
+        REQUIRE(data[2] == 6.0_a);
+        REQUIRE(top == l.top());
+    }
+
+    SECTION("span arguments") {
+        l.provide(LUA_TNAME("scale"), [](std::span<double> v, double k) {
+            for (auto& e : v) e *= k;
+        });
+        l.provide(LUA_TNAME("csum"), [](std::span<const int32_t> v) {
+            int32_t s = 0;
+            for (auto e : v) s += e;
+            return s;
+        });
+        l.load_and_call(lua_code{R"(
+            a = typed_array.float64(3)
+            fill(a, 1)
+            scale(a, 10)
+            r = a[3]
+            c = csum(make())
+        )"});
+        REQUIRE(l.extract<double>(LUA_TNAME("r")) == 30.0_a);
+        REQUIRE(l.extract<int>(LUA_TNAME("c")) == 6);
+        l.load_and_call(lua_code{"ok = pcall(csum, {1, 2, 3})"});
+        REQUIRE(!l.extract<bool>(LUA_TNAME("ok")));
+        REQUIRE(top == l.top());
+    }
+
+    SECTION("errors") {
+        l.load_and_call(lua_code{"a = typed_array.uint8(2)"});
+        lua_getglobal(l.state(), "a");
+        REQUIRE(luacheck<std::span<uint8_t>>(l.state(), -1));
+        REQUIRE(!luacheck<std::span<int32_t>>(l.state(), -1));
+        REQUIRE_THROWS_AS(luaget<std::span<float>>(l.state(), -1), errors::cast_error);
+        lua_pop(l.state(), 1);
+
+        l.load_and_call(lua_code{"ok1 = out_of_range(a) ok2 = set_string(a) a[2] = 300"});
+        REQUIRE(!l.extract<bool>(LUA_TNAME("ok1")));
+        REQUIRE(!l.extract<bool>(LUA_TNAME("ok2")));
+
+        /* NaN passes neither the index nor the size checks */
+        l.load_and_call(lua_code{R"(
+            nan_set = pcall(function() a[0/0] = 1 end)
+            nan_get = pcall(function() return a[0/0] end)
+            nan_size = pcall(typed_array.float64, 0/0)
+            huge_size = pcall(typed_array.float64, 1e300)
+        )"});
+        REQUIRE(!l.extract<bool>(LUA_TNAME("nan_set")));
+        REQUIRE(!l.extract<bool>(LUA_TNAME("nan_get")));
+        REQUIRE(!l.extract<bool>(LUA_TNAME("nan_size")));
+        REQUIRE(!l.extract<bool>(LUA_TNAME("huge_size")));
+
+        /* Integer elements are range-checked instead of narrowed */
+        l.load_and_call(lua_code{R"(
+            local i32 = typed_array.int32(1)
+            local u8 = typed_array.uint8(1)
+            i32_nan = pcall(function() i32[1] = 0/0 end)
+            i32_huge = pcall(function() i32[1] = 1e300 end)
+            i32_big = pcall(function() i32[1] = 2^40 end)
+            u8_nan = pcall(function() u8[1] = 0/0 end)
+            u8_300 = pcall(function() u8[1] = 300 end)
+            u8_table = pcall(typed_array.uint8, {1, 300})
+            i32_table = pcall(typed_array.int32, {1, 1e300})
+            u8[1] = 255
+            i32[1] = -2.5
+            u8_value, i32_value = u8[1], i32[1]
+        )"});
+        for (auto name : {"i32_nan", "i32_huge", "i32_big", "u8_nan", "u8_300", "u8_table", "i32_table"})
+            REQUIRE(!l.extract<bool>(lua_name{name}));
+        REQUIRE(l.extract<int>(LUA_TNAME("u8_value")) == 255);
+        REQUIRE(l.extract<int>(LUA_TNAME("i32_value")) == -2);
+        REQUIRE(top == l.top());
+    }
+}
+
+TEST_CASE("ffi struct usertypes") {
+    auto l = luactx(lua_code{R"(
+        function point_type(p) return type(p) end
+        function make_point() return ffi_point.ctype(3, 4, 7) end
+        function point_method(p) return p:length(), p.id end
+        function scale(p, k) p.x = p.x * k p.y = p.y * k return p end
+        function point_id(p) return ffi_point_id(p) end
+    )"});
+    l.provide(LUA_TNAME("length"), &ffi_point::length);
+    auto top = l.top();
+
+    bool enabled = l.set_ffi_struct<ffi_point>(
+        {ffi_field("x", &ffi_point::x), ffi_field("y", &ffi_point::y), ffi_field("id", &ffi_point::id)});
+
+#ifdef WITH_LUAJIT
+    REQUIRE(enabled);
+    REQUIRE(l.extract<std::string(const ffi_point&)>(LUA_TNAME("point_type"))(ffi_point{1, 2, 3}) == "cdata");
+
+    auto p = l.extract<ffi_point()>(LUA_TNAME("make_point"))();
+    REQUIRE(p.x == 3.0_a);
+    REQUIRE(p.y == 4.0_a);
+    REQUIRE(p.id == 7);
+
+    auto [length, id] = l.extract<multiresult<double, int>(const ffi_point&)>(LUA_TNAME("point_method"))(p).storage;
+    REQUIRE(length == 25.0_a);
+    REQUIRE(id == 7);
+
+    auto scaled = l.extract<ffi_point(const ffi_point&, double)>(LUA_TNAME("scale"))(p, 2.0);
+    REQUIRE(scaled.x == 6.0_a);
+    REQUIRE(scaled.id == 7);
+
+    /* FFI functions take the pointers to the FFI structs with their ctype, other usertypes are rejected */
+    l.provide_ffi(LUA_TNAME("ffi_point_id"), [](const ffi_point* p) noexcept { return p->id; });
+    REQUIRE(l.extract<int(const ffi_point&)>(LUA_TNAME("point_id"))(ffi_point{1, 2, 3}) == 3);
+    static_assert(LuaFfiPodPointer<ffi_point*>);
+    static_assert(!LuaFfiPodPointer<cache_line_counter*>);
+
+    /* Registration is idempotent within the state */
+    REQUIRE(l.set_ffi_struct<ffi_point>(
+        {ffi_field("x", &ffi_point::x), ffi_field("y", &ffi_point::y), ffi_field("id", &ffi_point::id)}));
+#else
+    REQUIRE(!enabled);
+    REQUIRE(l.extract<std::string(const ffi_point&)>(LUA_TNAME("point_type"))(ffi_point{1, 2, 3}) == "userdata");
+#endif
+    REQUIRE(l.top() == top);
+}